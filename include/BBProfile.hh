@@ -0,0 +1,78 @@
+#ifndef BB_PROFILE_HH
+#define BB_PROFILE_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+
+#include <cstdint>
+
+namespace llvm {
+class Function;
+class raw_ostream;
+
+/// Binary profile written by count-bb with -count-bb-output=binary and by
+/// bbmerge.out, in host byte order:
+///
+///   Header
+///   FunctionRecord x NumFunctions
+///   (padding up to CountersOffset)
+///   uint64_t x NumCounters
+///
+/// Every function owns the slice [CounterBase, CounterBase + NumCounters) of
+/// the counters, and with -count-bb-paths the Ball-Larus path counters
+/// [PathCounterBase, PathCounterBase + NumPathCounters) indexed by path ID.
+/// Readers match functions by NameHash and must drop a record whose
+/// CFGChecksum differs from the CFG they hold.
+namespace bbprof {
+
+uint64_t const k_magic = 0x666f727062626c6cULL;  // "llbbprof"
+uint32_t const k_version = 2;
+
+/// Header::Mode, the layouts of -count-bb-mode
+enum ProfileMode : uint32_t { k_modeTotal = 0, k_modeBlock = 1, k_modeEdge = 2 };
+
+struct Header {
+  uint64_t Magic;
+  uint32_t Version;
+  uint32_t Mode;
+  uint64_t NumFunctions;
+  uint64_t NumCounters;
+  uint64_t CountersOffset;
+};
+
+struct FunctionRecord {
+  uint64_t NameHash;
+  uint64_t CFGChecksum;
+  uint64_t CounterBase;
+  uint64_t NumCounters;
+  uint64_t PathCounterBase;
+  uint64_t NumPathCounters;
+};
+
+/// a parsed profile, pointing into the buffer it was read from
+struct ProfileView {
+  Header const *H = nullptr;
+  ArrayRef<FunctionRecord> Functions;
+  ArrayRef<uint64_t> Counters;
+
+  ArrayRef<uint64_t> countersOf(FunctionRecord const &R) const {
+    return Counters.slice(R.CounterBase, R.NumCounters);
+  }
+  ArrayRef<uint64_t> pathCountersOf(FunctionRecord const &R) const {
+    return Counters.slice(R.PathCounterBase, R.NumPathCounters);
+  }
+};
+
+uint64_t functionHash(StringRef Name);
+/// hash of the block count and successor lists of F, in block order
+uint64_t cfgChecksum(Function const &F);
+
+/// Buffer has to stay alive and 8-byte aligned (MemoryBuffer is)
+Expected<ProfileView> readProfile(StringRef Buffer);
+void writeProfile(raw_ostream &OS, uint32_t Mode, ArrayRef<FunctionRecord> Functions,
+                  ArrayRef<uint64_t> Counters);
+
+}  // namespace bbprof
+}  // namespace llvm
+#endif
@@ -0,0 +1,132 @@
+#ifndef DATAFLOW_HH
+#define DATAFLOW_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/PassManager.h"
+
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class Instruction;
+class StoreInst;
+class Value;
+
+/// A gen/kill bit-vector dataflow problem over the blocks of a function,
+/// numbered in function order. The transfer function of a block is sparse:
+///
+///   forward:   Out = Gen | (In  - Kill),  In  = meet(Out of preds) | MeetGen
+///   backward:  In  = Gen | (Out - Kill),  Out = meet(In of succs)  | MeetGen
+///
+/// Gen lists bits, Kill lists [begin, end) ranges, so a problem that numbers
+/// the facts killed together contiguously (the definitions of a variable,
+/// say) kills them word by word. MeetGen is joined on the meet side, before
+/// Kill, e.g. the phi operands a block passes to its successors. Blocks
+/// without a predecessor (forward) or successor (backward) meet to Boundary.
+struct DataflowProblem {
+  enum Direction { Forward, Backward };
+  enum Meet { Union, Intersect };
+
+  DataflowProblem(unsigned NumBlocks, unsigned NumBits, Direction Dir, Meet M)
+      : NumBits(NumBits), Dir(Dir), MeetOp(M), Gen(NumBlocks), Kill(NumBlocks), MeetGen(NumBlocks),
+        Boundary(NumBits) {}
+
+  unsigned NumBits;
+  Direction Dir;
+  Meet MeetOp;
+  std::vector<SmallVector<unsigned, 4>> Gen;
+  std::vector<SmallVector<std::pair<unsigned, unsigned>, 4>> Kill;
+  std::vector<SmallVector<unsigned, 2>> MeetGen;
+  BitVector Boundary;
+};
+
+/// the fixpoint, In at the entry and Out at the exit of every block
+struct DataflowResult {
+  std::vector<BitVector> In;
+  std::vector<BitVector> Out;
+};
+
+/// Solves P over F. Blocks are visited in reverse postorder of the CFG
+/// (forward) or of the reverse CFG (backward), unreachable ones after, and
+/// a sweep only revisits the blocks whose input changed, so a reducible CFG
+/// settles in loop-depth + 2 sweeps. Memory is #blocks * NumBits * 2 bits.
+DataflowResult solveDataflow(Function const &F, DataflowProblem const &P);
+
+/// Reaching definitions of the memory variables of a function: a variable
+/// is an alloca or a global, a definition a store straight to it (through
+/// pointer casts). Stores through other pointers and calls are not seen as
+/// definitions. The definitions of a variable are numbered contiguously.
+class ReachingDefinitions {
+ public:
+  explicit ReachingDefinitions(Function const &F);
+
+  /// definition number -> store
+  ArrayRef<StoreInst const *> defs() const { return Defs; }
+  Value const *getVariable(StoreInst const *S) const;
+  /// bits set for the definitions reaching the entry / exit of B
+  BitVector const &getIn(BasicBlock const *B) const { return Result.In[Blocks.lookup(B)]; }
+  BitVector const &getOut(BasicBlock const *B) const { return Result.Out[Blocks.lookup(B)]; }
+  /// the definitions of Var reaching I, I itself excluded
+  void getReachingDefs(Instruction const *I, Value const *Var, SmallVectorImpl<StoreInst const *> &Out) const;
+
+ private:
+  DenseMap<BasicBlock const *, unsigned> Blocks;
+  std::vector<StoreInst const *> Defs;
+  DenseMap<StoreInst const *, unsigned> DefNumbers;
+  /// variable -> [begin, end) of its definitions
+  DenseMap<Value const *, std::pair<unsigned, unsigned>> Vars;
+  DataflowResult Result;
+};
+
+/// Liveness of the SSA values of a function. Only the values used outside
+/// of their block get a bit, the others are never live across a block
+/// boundary. A phi operand is live out of the incoming block only.
+class Liveness {
+ public:
+  explicit Liveness(Function const &F);
+
+  /// value number -> value, arguments and instructions
+  ArrayRef<Value const *> values() const { return Values; }
+  bool isLiveIn(Value const *V, BasicBlock const *B) const { return test(Result.In, V, B); }
+  bool isLiveOut(Value const *V, BasicBlock const *B) const { return test(Result.Out, V, B); }
+  BitVector const &getIn(BasicBlock const *B) const { return Result.In[Blocks.lookup(B)]; }
+  BitVector const &getOut(BasicBlock const *B) const { return Result.Out[Blocks.lookup(B)]; }
+
+ private:
+  bool test(std::vector<BitVector> const &Sets, Value const *V, BasicBlock const *B) const {
+    auto it = Numbers.find(V);
+    return it != Numbers.end() && Sets[Blocks.lookup(B)].test(it->second);
+  }
+
+  DenseMap<BasicBlock const *, unsigned> Blocks;
+  std::vector<Value const *> Values;
+  DenseMap<Value const *, unsigned> Numbers;
+  DataflowResult Result;
+};
+
+/// new pass manager analyses
+class ReachingDefinitionsAnalysis : public AnalysisInfoMixin<ReachingDefinitionsAnalysis> {
+  friend AnalysisInfoMixin<ReachingDefinitionsAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  using Result = ReachingDefinitions;
+  Result run(Function &F, FunctionAnalysisManager &FAM) { return ReachingDefinitions(F); }
+};
+
+class LivenessAnalysis : public AnalysisInfoMixin<LivenessAnalysis> {
+  friend AnalysisInfoMixin<LivenessAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  using Result = Liveness;
+  Result run(Function &F, FunctionAnalysisManager &FAM) { return Liveness(F); }
+};
+
+}  // namespace llvm
+#endif
@@ -0,0 +1,92 @@
+#ifndef DEF_USE_HH
+#define DEF_USE_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class Function;
+class Value;
+
+/// Snapshot of the def-use graph of one function in compressed sparse rows.
+/// The arguments and then the instructions, in function order, get dense
+/// ids; the operands and the users of id v are the slices
+/// [OperandBegin[v], OperandBegin[v + 1]) and [UserBegin[v], UserBegin[v + 1])
+/// of two flat id arrays. Operands that are neither an argument nor an
+/// instruction (constants, globals, blocks) are left out. A value used
+/// twice by one instruction lists it twice, as its use list does.
+///
+/// Building it reads every operand once and fills the user rows by counting,
+/// without walking a use list. The snapshot has to be rebuilt once an
+/// instruction or an operand of the function changes.
+class DefUseIndex {
+ public:
+  explicit DefUseIndex(Function const &F);
+
+  unsigned size() const { return Values.size(); }
+  ArrayRef<Value const *> values() const { return Values; }
+  Value const *getValue(unsigned ID) const { return Values[ID]; }
+  /// ~0U for a value of another function or one that is not indexed
+  unsigned getID(Value const *V) const;
+
+  ArrayRef<unsigned> operands(unsigned ID) const {
+    return makeArrayRef(OperandIDs).slice(OperandBegin[ID], OperandBegin[ID + 1] - OperandBegin[ID]);
+  }
+  ArrayRef<unsigned> users(unsigned ID) const {
+    return makeArrayRef(UserIDs).slice(UserBegin[ID], UserBegin[ID + 1] - UserBegin[ID]);
+  }
+  unsigned getNumEdges() const { return OperandIDs.size(); }
+
+  /// adds to Slice (resized to size()) the values transitively using one of
+  /// Seeds, the seeds included
+  void forwardSlice(ArrayRef<unsigned> Seeds, BitVector &Slice) const;
+  /// the same along the operands, what the seeds transitively depend on
+  void backwardSlice(ArrayRef<unsigned> Seeds, BitVector &Slice) const;
+
+ private:
+  void slice(ArrayRef<unsigned> Seeds, BitVector &Slice, std::vector<unsigned> const &Begin,
+             std::vector<unsigned> const &Edges) const;
+
+  std::vector<Value const *> Values;
+  DenseMap<Value const *, unsigned> IDs;
+  std::vector<unsigned> OperandBegin;
+  std::vector<unsigned> OperandIDs;
+  std::vector<unsigned> UserBegin;
+  std::vector<unsigned> UserIDs;
+};
+
+/// new pass manager analysis
+class DefUseAnalysis : public AnalysisInfoMixin<DefUseAnalysis> {
+  friend AnalysisInfoMixin<DefUseAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  using Result = DefUseIndex;
+  Result run(Function &F, FunctionAnalysisManager &FAM) { return DefUseIndex(F); }
+};
+
+/// legacy pass manager analysis, `AU.addRequired<DefUseWrapperPass>()`
+class DefUseWrapperPass : public FunctionPass {
+ public:
+  static char ID;
+
+  DefUseWrapperPass() : FunctionPass(ID) {}
+
+  DefUseIndex &getIndex() { return *Index; }
+
+  bool runOnFunction(Function &F) override;
+  void releaseMemory() override { Index.reset(); }
+  void getAnalysisUsage(AnalysisUsage &AU) const override { AU.setPreservesAll(); }
+
+ private:
+  std::unique_ptr<DefUseIndex> Index;
+};
+
+}  // namespace llvm
+#endif
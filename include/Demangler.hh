@@ -0,0 +1,54 @@
+#ifndef DEMANGLER_HH
+#define DEMANGLER_HH
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+
+#include <string>
+
+namespace llvm {
+class Module;
+
+/// cppDemangle with the results interned: a name is demangled once, and the
+/// mangled and demangled strings both live in one bump arena, so the
+/// StringRefs handed out stay valid as long as the Demangler. A name without
+/// the _Z prefix of the Itanium ABI, or one __cxa_demangle rejects,
+/// demangles to itself.
+///
+/// demangle() is not thread-safe; demangleModule() spreads the
+/// __cxa_demangle calls over a thread pool and interns the results after.
+class Demangler {
+ public:
+  Demangler() = default;
+  Demangler(Demangler const &) = delete;
+  Demangler &operator=(Demangler const &) = delete;
+  ~Demangler();
+
+  StringRef demangle(StringRef Mangled);
+  /// the interned name, empty if Mangled was never demangled
+  StringRef lookup(StringRef Mangled) const { return Names.lookup(Mangled); }
+
+  /// demangles the names of every function, global variable and alias of M
+  /// not interned yet, on NumThreads threads, 0 for one per core
+  void demangleModule(Module const &M, unsigned NumThreads = 0);
+
+  size_t size() const { return Names.size(); }
+
+ private:
+  /// __cxa_demangle of Mangled, nullptr if it is no mangled name. The
+  /// result is left in Buf, the malloc'ed buffer __cxa_demangle reuses
+  /// across calls; Key holds the null-terminated copy of Mangled
+  static char const *demangleRaw(StringRef Mangled, std::string &Key, char *&Buf, size_t &BufSize);
+  /// Demangled == nullptr interns Mangled as its own demangled name
+  StringRef intern(StringRef Mangled, char const *Demangled);
+
+  StringMap<StringRef, BumpPtrAllocator> Names;
+  /// demangle()'s scratch
+  std::string Key;
+  char *Buf = nullptr;
+  size_t BufSize = 0;
+};
+
+}  // namespace llvm
+#endif
@@ -0,0 +1,54 @@
+#ifndef DIAGNOSTICS_HH
+#define DIAGNOSTICS_HH
+
+#include "llvm/ADT/StringRef.h"
+
+#include <cstdint>
+
+/// messages below this level are compiled out of rbscope_diagnostics, set
+/// with -DRB_DIAGNOSTICS_MIN_LEVEL=1 to drop LOG, =2 to drop LOG and WARN;
+/// ERROR and FATAL are always reported
+#ifndef RB_DIAGNOSTICS_MIN_LEVEL
+#define RB_DIAGNOSTICS_MIN_LEVEL 0
+#endif
+
+namespace llvm {
+class raw_ostream;
+
+enum RB_Diagnostics {
+  LOG,
+  WARN,
+  ERROR,
+  FATAL
+};
+
+/// The sink behind rbscope_diagnostics. Every thread formats its messages
+/// into a buffer of its own, handed to stderr in one write when it fills
+/// up, when the thread ends, on ERROR and FATAL, and on flush(); the lines of
+/// two threads never interleave. Colors are written only when stderr is a
+/// terminal.
+namespace diag {
+
+/// appends one message of the given level to this thread's buffer; ERROR
+/// and FATAL flush every buffer and abort
+void emit(RB_Diagnostics level, StringRef msg);
+/// writes out the buffers of all threads, call it before writing to errs()
+/// directly when the order matters
+void flush();
+/// messages emitted so far at a level, by all threads
+uint64_t getCount(RB_Diagnostics level);
+/// errs() is a terminal, asked once
+bool stderrHasColors();
+/// OS has colors enabled and is a terminal, or is a buffer whose colors
+/// were enabled for the stream it goes to
+bool hasColors(raw_ostream &OS);
+
+}  // namespace diag
+
+inline void rbscope_diagnostics(RB_Diagnostics level, char const *msg) {
+  if (level < RB_DIAGNOSTICS_MIN_LEVEL && level < RB_Diagnostics::ERROR) return;
+  diag::emit(level, msg);
+}
+
+}  // namespace llvm
+#endif
@@ -0,0 +1,65 @@
+#ifndef EDGE_PROFILE_HH
+#define EDGE_PROFILE_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+
+/// Placement of edge counters after Knuth: the CFG, closed by a virtual node
+/// that every exit block flows into and the entry block flows out of, is
+/// covered by a maximum spanning tree weighted by loop depth. Only the edges
+/// off the tree get a counter, the tree edges follow from flow conservation.
+///
+/// The plan is a pure function of the uninstrumented CFG, so count-bb and
+/// the offline reconstruction in bbprof.out agree on it.
+class EdgeProfilePlan {
+ public:
+  /// where the counter of an edge goes
+  enum Placement {
+    InSrc,  ///< before the terminator of Src, Src has no other successor
+    InDst,  ///< at the top of Dst, Dst has no other predecessor
+    Split   ///< in a new block on the split critical edge
+  };
+
+  struct Edge {
+    BasicBlock *Src;  ///< nullptr for the virtual edge into the entry block
+    BasicBlock *Dst;  ///< nullptr for the virtual edges out of exit blocks
+    uint64_t Weight;
+    Placement Where;
+    /// counter slot within the function, -1 for edges on the tree
+    int Counter;
+  };
+
+  explicit EdgeProfilePlan(Function &F);
+
+  /// where code for the edge Src -> Dst goes, Split for a critical edge
+  static Placement placementOf(BasicBlock const *Src, BasicBlock const *Dst);
+  /// critical edges out of indirectbr/callbr and into EH pads cannot be split
+  static bool canSplit(BasicBlock const *Src, BasicBlock const *Dst);
+
+  /// false if edges that cannot carry a counter form a cycle, the function
+  /// then has to be profiled with one counter per block
+  bool isValid() const { return Valid; }
+  ArrayRef<Edge> edges() const { return Edges; }
+  unsigned getNumCounters() const { return NumCounters; }
+
+  /// recovers the count of every edge (in edges() order) and of every block
+  /// from the values of the counters
+  void reconstruct(ArrayRef<uint64_t> Counters, std::vector<uint64_t> &EdgeCounts,
+                   DenseMap<BasicBlock const *, uint64_t> &BlockCounts) const;
+
+ private:
+  std::vector<Edge> Edges;
+  /// blocks in function order, the virtual node is index Blocks.size()
+  std::vector<BasicBlock *> Blocks;
+  unsigned NumCounters = 0;
+  bool Valid = true;
+};
+
+}  // namespace llvm
+#endif
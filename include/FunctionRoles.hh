@@ -0,0 +1,87 @@
+#ifndef FUNCTION_ROLES_HH
+#define FUNCTION_ROLES_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class CallInst;
+class Function;
+class Module;
+
+/// what the checkers care about in a callee, a bitmask
+enum FnRole : unsigned {
+  k_roleAllocator = 1 << 0,     // utils::isFn_malloc
+  k_roleDeallocator = 1 << 1,   // utils::isFn_free
+  k_roleMemIntrinsic = 1 << 2,  // llvm.memcpy, llvm.memmove, llvm.memset
+  k_roleAssert = 1 << 3,        // __assert_fail
+  k_roleExit = 1 << 4,          // exit, _exit, _Exit, abort
+};
+unsigned const k_numFnRoles = 5;
+
+/// Roles of the functions of a module and the direct calls to them, built in
+/// one pass over the module so that the checkers stop comparing names for
+/// every call they look at. Roles are looked up by Function*, the call sites
+/// of a role are kept grouped by caller, in module order.
+///
+/// The index describes the calls it was built from and has to be rebuilt
+/// once a call is added or removed.
+class FunctionRoleIndex {
+ public:
+  explicit FunctionRoleIndex(Module &M);
+
+  /// FnRole bits of F, 0 for functions of no interest and for nullptr
+  unsigned getRoles(Function const *F) const { return F ? Roles.lookup(F) : 0; }
+  bool hasRole(Function const *F, FnRole R) const { return getRoles(F) & R; }
+
+  /// direct calls to a function of role R
+  ArrayRef<CallInst *> getCallSites(FnRole R) const { return Sites[roleNumber(R)]; }
+  /// the same, restricted to the calls in Caller
+  ArrayRef<CallInst *> getCallSites(FnRole R, Function const *Caller) const;
+
+  /// FnRole bits of F from its name or intrinsic ID, what the index holds
+  static unsigned classify(Function const &F);
+
+ private:
+  static unsigned roleNumber(FnRole R) { return countTrailingZeros(unsigned(R)); }
+
+  DenseMap<Function const *, unsigned> Roles;
+  std::vector<CallInst *> Sites[k_numFnRoles];
+  /// [begin, end) of the calls in a caller, per role
+  DenseMap<Function const *, std::pair<unsigned, unsigned>> CallerSites[k_numFnRoles];
+};
+
+/// new pass manager analysis
+class FunctionRoleAnalysis : public AnalysisInfoMixin<FunctionRoleAnalysis> {
+  friend AnalysisInfoMixin<FunctionRoleAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  using Result = FunctionRoleIndex;
+  Result run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+/// legacy pass manager analysis, `AU.addRequired<FunctionRoleWrapperPass>()`
+class FunctionRoleWrapperPass : public ModulePass {
+ public:
+  static char ID;
+
+  FunctionRoleWrapperPass() : ModulePass(ID) {}
+
+  FunctionRoleIndex &getIndex() { return *Index; }
+
+  bool runOnModule(Module &M) override;
+  void releaseMemory() override { Index.reset(); }
+  void getAnalysisUsage(AnalysisUsage &AU) const override { AU.setPreservesAll(); }
+
+ private:
+  std::unique_ptr<FunctionRoleIndex> Index;
+};
+
+}  // namespace llvm
+#endif
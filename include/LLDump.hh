@@ -8,6 +8,8 @@
 #include "llvm/IR/PassManager.h"
 #include <string>
 
+#include "Diagnostics.hh"
+
 namespace llvm {
 class Instruction;
 class Type;
@@ -16,11 +18,21 @@ class Function;
 class Module;
 }
 
-#define WITH_COLOR(color, x)         \
-  {                                  \
-    llvm::errs().changeColor(color); \
-    x;                               \
-    llvm::errs().resetColor();       \
+/// colors only when stderr is a terminal, not in redirected logs
+#define WITH_COLOR(color, x)                                 \
+  {                                                          \
+    bool const colored_ = llvm::diag::stderrHasColors();     \
+    if (colored_) llvm::errs().changeColor(color);           \
+    x;                                                       \
+    if (colored_) llvm::errs().resetColor();                 \
+  }
+
+#define WITH_COLOR_OS(os, color, x)                          \
+  {                                                          \
+    bool const colored_ = llvm::diag::hasColors(os);         \
+    if (colored_) (os).changeColor(color);                   \
+    x;                                                       \
+    if (colored_) (os).resetColor();                         \
   }
 
 #define BEG_FUN_LOG()                                                      \
@@ -43,10 +55,8 @@ static std::string ToString(const T *obj) {
   return N.str();
 }
 
-std::string InstTypeStr(char const *instTypeChars);
-
-void dumpLinkageType(llvm::GlobalValue &GV);
-void dumpGVInfo(llvm::GlobalValue &GV);
+void dumpLinkageType(llvm::GlobalValue &GV, raw_ostream &OS = errs());
+void dumpGVInfo(llvm::GlobalValue &GV, raw_ostream &OS = errs());
 void dumpPassKind(PassKind kind);
 
 static inline StringRef ppName(StringRef name) {
@@ -57,30 +67,12 @@ static inline StringRef ppName(StringRef name) {
   }
 }
 
-void printInstKind(Instruction const &);
+/// class-hierarchy path of an instruction below Instruction, e.g.
+/// "UnaryInstruction <-- CastInst <-- BitCastInst", from a table by opcode
+/// and intrinsic ID; nothing is allocated
+StringRef getInstKindStr(Instruction const &I);
+void printInstKind(Instruction const &I, raw_ostream &OS = errs());
 void prettyPrint(Value const *V, unsigned endLine = 0, unsigned startLine = 0);
 
-enum RB_Diagnostics {
-  LOG,
-  WARN,
-  ERROR,
-  FATAL
-};
-
-inline void rbscope_diagnostics(RB_Diagnostics level, char const *msg) {
-  switch (level) {
-    case RB_Diagnostics::LOG: WITH_COLOR(raw_ostream::CYAN, errs() << "LOG: " << msg << "\n");
-      break;
-    case RB_Diagnostics::WARN: WITH_COLOR(raw_ostream::YELLOW, errs() << "WARN: " << msg << "\n");
-      break;
-    case RB_Diagnostics::ERROR: WITH_COLOR(raw_ostream::MAGENTA, errs() << "ERROR: " << msg << "\n");
-      abort();
-      break;
-    case RB_Diagnostics::FATAL: WITH_COLOR(raw_ostream::RED, errs() << "FATAL: " << msg << "\n");
-      abort();
-      break;
-  }
-}
-
 }  // namespace llvm
 #endif
@@ -0,0 +1,70 @@
+#ifndef LOOP_COST_HH
+#define LOOP_COST_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+class Instruction;
+class LoopNestReport;
+class raw_ostream;
+
+/// Estimated latency of I in cycles on a generic out-of-order core, from a
+/// table by opcode: PHIs, allocas and no-op casts are free, divisions and
+/// atomics are expensive, and a call that is no cheap intrinsic costs
+/// k_callLatency whatever it calls.
+unsigned getInstLatency(Instruction const &I);
+unsigned const k_callLatency = 25;
+
+/// iterations assumed for a loop SCEV cannot bound, also the cap of a
+/// loop only bounded from above
+uint64_t const k_defaultUnknownTrips = 100;
+
+/// static cost of one loop of a LoopNestReport, per call of its function
+struct LoopCost {
+  /// latency of one iteration over the loop's own blocks, the subloops'
+  /// blocks left out
+  uint64_t IterLatency = 0;
+  /// iterations per entry of the loop, exact if TripsKnown
+  uint64_t Trips = 0;
+  bool TripsKnown = false;
+  /// iterations per call of the function, Trips times the parents' Trips
+  uint64_t Frequency = 0;
+  /// cycles spent in the own blocks per call, IterLatency * Frequency
+  uint64_t SelfCost = 0;
+  /// SelfCost plus the TotalCost of the subloops
+  uint64_t TotalCost = 0;
+};
+
+/// the costs of the loops of Report, in its order; Report has to have its
+/// trip counts, without them every loop runs UnknownTrips times
+std::vector<LoopCost> computeLoopCosts(LoopNestReport const &Report,
+                                       uint64_t UnknownTrips = k_defaultUnknownTrips);
+
+/// a loop in a ranking across functions and modules
+struct HotLoop {
+  std::string Module;
+  std::string Function;
+  std::string Header;
+  unsigned Depth = 0;
+  LoopCost Cost;
+};
+
+/// appends the loops of Report with their Costs to Out
+void collectHotLoops(LoopNestReport const &Report, ArrayRef<LoopCost> Costs, StringRef Module,
+                     std::vector<HotLoop> &Out);
+/// sorts Loops by SelfCost, highest first, and keeps the first N. SelfCost
+/// ranks the cycles of every block once, where TotalCost would rank a whole
+/// nest above its own hottest loop.
+void rankHotLoops(std::vector<HotLoop> &Loops, size_t N);
+/// one line per loop, or one JSON record per line:
+///
+///   {"rec":"hot_loop","rank","module","fn","header","depth","self_cost",
+///    "total_cost","iter_latency","trips","trips_known","frequency"}
+void printHotLoops(raw_ostream &OS, ArrayRef<HotLoop> Loops, bool Jsonl);
+
+}  // namespace llvm
+#endif
@@ -0,0 +1,82 @@
+#ifndef LOOP_NEST_HH
+#define LOOP_NEST_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <string>
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+class Loop;
+class LoopInfo;
+class ScalarEvolution;
+class raw_ostream;
+
+/// one loop of a nest, see LoopNestReport
+struct LoopRecord {
+  Loop const *L = nullptr;
+  /// index of the enclosing loop in the report, -1 for a top-level loop
+  int Parent = -1;
+  unsigned Depth = 0;
+  BasicBlock const *Header = nullptr;
+  BasicBlock const *Preheader = nullptr;
+  SmallVector<BasicBlock const *, 2> Exits;
+  unsigned NumBlocks = 0;
+  /// instructions of the body, the subloops' included
+  uint64_t NumInsts = 0;
+  /// of the blocks of this loop that are in no subloop
+  uint64_t NumOwnInsts = 0;
+
+  /// the SCEV backedge-taken count as printed, empty if SCEV gave up
+  std::string BackedgeTaken;
+  Optional<uint64_t> ConstBackedgeTaken;
+  Optional<uint64_t> MaxBackedgeTaken;
+  /// instructions executed per entry of the loop: iterations times the own
+  /// instructions plus the estimates of the subloops, from the exact trip
+  /// counts; unset if one of them is unknown
+  Optional<uint64_t> EstimatedInsts;
+};
+
+/// The loop nest of a function as a preorder list of LoopRecords, built
+/// from LoopInfo alone; the trip counts and the estimates are added by
+/// addTripCounts. The two steps are split because ScalarEvolution creates
+/// constants and value handles in the LLVMContext, which is not thread-safe,
+/// while the structure can be built for several functions at once.
+class LoopNestReport {
+ public:
+  LoopNestReport(Function const &F, LoopInfo const &LI);
+
+  void addTripCounts(ScalarEvolution &SE);
+
+  Function const &getFunction() const { return F; }
+  ArrayRef<LoopRecord> loops() const { return Loops; }
+  bool empty() const { return Loops.empty(); }
+
+  /// one indented line per loop
+  void print(raw_ostream &OS) const;
+  /// one {"rec":"loop"} JSON record per line, blocks by their number in
+  /// function order as in ir_dump.out's block records:
+  ///
+  ///   {"rec":"loop","fn","id","parent","depth","header","header_name",
+  ///    "preheader","exits":[id],"blocks","insts","own_insts",
+  ///    "backedge_taken","btc","max_btc","est_insts"}
+  ///
+  /// parent is -1 for a top-level loop, unknown values are left out
+  void writeJsonl(raw_ostream &OS) const;
+
+  /// the name of B, bb<number in function order> if it has none
+  void printBlock(raw_ostream &OS, BasicBlock const *B) const;
+
+ private:
+  Function const &F;
+  DenseMap<BasicBlock const *, unsigned> BlockNumbers;
+  std::vector<LoopRecord> Loops;
+};
+
+}  // namespace llvm
+#endif
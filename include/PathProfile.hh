@@ -0,0 +1,75 @@
+#ifndef PATH_PROFILE_HH
+#define PATH_PROFILE_HH
+
+#include "llvm/ADT/APInt.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <vector>
+
+#include "EdgeProfile.hh"
+
+namespace llvm {
+class BasicBlock;
+class Function;
+
+/// Ball-Larus numbering of the acyclic paths of a function. Back edges
+/// (found by a DFS from the entry) are cut, a path runs from the function
+/// entry or a loop header reached by a back edge, to a function exit or the
+/// source of a back edge. Every DAG edge gets an increment so that the sum
+/// along a path is a unique ID in [0, getNumPaths()).
+///
+/// The number of paths grows exponentially with the number of branches in
+/// sequence, so it is kept in an APInt wide enough for any function. Like
+/// EdgeProfilePlan, the numbering depends on the uninstrumented CFG only.
+class PathNumbering {
+ public:
+  /// code on a real CFG edge: `path += Inc` on a forward edge; on a back
+  /// edge `count(path + Inc)` ends the current path and `path = Reset`
+  /// starts the one through the loop header
+  struct EdgeAction {
+    BasicBlock *Src;
+    BasicBlock *Dst;
+    EdgeProfilePlan::Placement Where;
+    bool IsBackEdge;
+    APInt Inc;
+    APInt Reset;
+  };
+
+  /// a path ID turned back into blocks
+  struct DecodedPath {
+    SmallVector<BasicBlock *, 16> Blocks;
+    bool FromBackEdge = false;  ///< starts at a loop header, not the entry
+    bool ToBackEdge = false;    ///< ends by taking a back edge, not an exit
+  };
+
+  explicit PathNumbering(Function &F);
+
+  APInt const &getNumPaths() const { return NumPaths; }
+  /// false if an edge needing code cannot be split (see EdgeProfilePlan)
+  bool isValid() const { return Valid; }
+  /// the edges needing code, zero increments on forward edges are left out
+  ArrayRef<EdgeAction> actions() const { return Actions; }
+  /// reachable blocks without successors, each counts `path` before leaving
+  ArrayRef<BasicBlock *> exits() const { return Exits; }
+
+  DecodedPath decode(APInt Id) const;
+
+ private:
+  struct DagEdge {
+    unsigned Dst;
+    APInt Inc;
+  };
+
+  /// blocks in function order, then the virtual root and exit nodes
+  std::vector<BasicBlock *> Blocks;
+  /// out-edges per node, in increasing order of Inc
+  std::vector<SmallVector<DagEdge, 2>> Succs;
+  std::vector<EdgeAction> Actions;
+  std::vector<BasicBlock *> Exits;
+  APInt NumPaths;
+  bool Valid = true;
+};
+
+}  // namespace llvm
+#endif
@@ -0,0 +1,135 @@
+#ifndef POINTS_TO_HH
+#define POINTS_TO_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/SparseBitVector.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class CallBase;
+class Constant;
+class Function;
+class Module;
+class Value;
+class raw_ostream;
+
+/// Whole-module inclusion-based (Andersen) points-to sets. The abstract
+/// objects are the allocas, the globals, the functions and the calls to an
+/// allocator (FunctionRoleIndex's k_roleAllocator), one object each, and
+/// field-insensitive: a GEP or a cast points to what its base points to.
+///
+/// Sets are SparseBitVectors of object numbers. The solver propagates the
+/// difference of a set since its last visit only, collapses a cycle of copy
+/// edges into one node once an edge joins two equal sets (lazy cycle
+/// detection), and resolves the indirect calls as function objects reach
+/// their callee. Pointers going through integers (ptrtoint, inttoptr) and
+/// those returned by external functions other than allocators point to
+/// nothing, so the sets are an under-approximation for such code.
+class PointsToGraph {
+ public:
+  using PointsToSet = SparseBitVector<>;
+
+  explicit PointsToGraph(Module &M);
+
+  /// object number -> alloca, global, function or allocator call
+  Value const *getObject(unsigned Object) const { return ObjectOf[Object]; }
+  /// object numbers, the numbers themselves are not dense
+  ArrayRef<unsigned> objects() const { return Objects; }
+  /// the object V is, ~0U if V is none
+  unsigned getObjectNumber(Value const *V) const;
+
+  /// objects V may point to, empty for a value that is not a pointer
+  PointsToSet const &getPointsTo(Value const *V) const;
+  void getPointees(Value const *V, SmallVectorImpl<Value const *> &Out) const;
+  /// objects a pointer stored in Object may point to
+  PointsToSet const &getContents(unsigned Object) const { return Nodes[find(Object)].Pts; }
+
+  /// true unless the points-to sets of A and B are disjoint
+  bool mayAlias(Value const *A, Value const *B) const { return getPointsTo(A).intersects(getPointsTo(B)); }
+
+  unsigned getNumNodes() const { return Nodes.size(); }
+  unsigned getNumCollapsed() const { return NumCollapsed; }
+
+  void print(raw_ostream &OS, Module const &M) const;
+
+ private:
+  struct Node {
+    PointsToSet Pts;
+    /// what has been propagated along the edges already
+    PointsToSet Prev;
+    /// copy edges, Pts(this) flows into Pts(target)
+    PointsToSet Copy;
+    /// Pts(target) includes the contents of what this points to
+    SmallVector<unsigned, 1> Loads;
+    /// the contents of what this points to include Pts(source)
+    SmallVector<unsigned, 1> Stores;
+    /// indirect calls through this
+    SmallVector<CallBase const *, 0> Calls;
+  };
+
+  unsigned newNode(Value const *Object = nullptr);
+  unsigned find(unsigned N) const;
+  unsigned getValueNode(Value const *V);
+  unsigned lookupValueNode(Value const *V) const;
+  void addInitializer(unsigned Object, Constant const *C);
+  void connectCall(CallBase const *CB, Function const *F);
+  void addEdge(unsigned From, unsigned To);
+  void push(unsigned N);
+  void collapseCycles(ArrayRef<unsigned> Roots);
+  void merge(unsigned Into, unsigned N);
+  void solve();
+
+  std::vector<Node> Nodes;
+  /// union-find parents, path compression happens behind const
+  mutable std::vector<unsigned> Rep;
+  std::vector<Value const *> ObjectOf;
+  std::vector<unsigned> Objects;
+  DenseMap<Value const *, unsigned> ValueNodes;
+  DenseMap<Value const *, unsigned> ObjectNodes;
+  DenseMap<Function const *, unsigned> ReturnNodes;
+
+  std::deque<unsigned> Worklist;
+  std::vector<bool> Queued;
+  DenseSet<std::pair<unsigned, unsigned>> CheckedEdges;
+  unsigned NumCollapsed = 0;
+};
+
+/// new pass manager analysis
+class PointsToAnalysis : public AnalysisInfoMixin<PointsToAnalysis> {
+  friend AnalysisInfoMixin<PointsToAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  using Result = PointsToGraph;
+  Result run(Module &M, ModuleAnalysisManager &MAM) { return PointsToGraph(M); }
+};
+
+/// legacy pass manager analysis, `AU.addRequired<PointsToWrapperPass>()`,
+/// `opt -points-to -analyze` prints the sets of a module
+class PointsToWrapperPass : public ModulePass {
+ public:
+  static char ID;
+
+  PointsToWrapperPass() : ModulePass(ID) {}
+
+  PointsToGraph &getGraph() { return *Graph; }
+
+  bool runOnModule(Module &M) override;
+  void releaseMemory() override { Graph.reset(); }
+  void getAnalysisUsage(AnalysisUsage &AU) const override { AU.setPreservesAll(); }
+  void print(raw_ostream &OS, Module const *M) const override;
+
+ private:
+  std::unique_ptr<PointsToGraph> Graph;
+};
+
+}  // namespace llvm
+#endif
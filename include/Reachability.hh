@@ -0,0 +1,84 @@
+#ifndef REACHABILITY_HH
+#define REACHABILITY_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class BasicBlock;
+class Function;
+
+/// Block-to-block reachability of one function, answered in O(1): the CFG is
+/// condensed into its SCCs, numbered in reverse topological order, and every
+/// SCC keeps the bitset of the SCCs it reaches. Building it is linear in the
+/// CFG plus one bitset OR per condensed edge, the bitsets take #SCC^2 bits.
+///
+/// The index describes the CFG it was built from and has to be rebuilt once
+/// a block or an edge changes; the analyses below take care of that.
+class ReachabilityIndex {
+ public:
+  explicit ReachabilityIndex(Function &F);
+
+  /// true if To can be reached from From, trivially so when From == To
+  bool reachable(BasicBlock const *From, BasicBlock const *To) const {
+    return sccReaches(getSCC(getBlockNumber(From)), getSCC(getBlockNumber(To)));
+  }
+
+  /// blocks in function order, numbered by their position
+  ArrayRef<BasicBlock *> blocks() const { return Blocks; }
+  unsigned getBlockNumber(BasicBlock const *B) const { return Numbers.lookup(B); }
+
+  unsigned getNumSCCs() const { return Closure.size(); }
+  unsigned getSCC(unsigned Block) const { return SCCOf[Block]; }
+  unsigned getSCCSize(unsigned SCC) const { return SCCSize[SCC]; }
+  /// an SCC reaches itself, whether or not it has a cycle
+  bool sccReaches(unsigned From, unsigned To) const { return Closure[From].test(To); }
+
+  /// new pass manager hook, the index survives anything preserving the CFG
+  bool invalidate(Function &F, PreservedAnalyses const &PA, FunctionAnalysisManager::Invalidator &Inv);
+
+ private:
+  std::vector<BasicBlock *> Blocks;
+  DenseMap<BasicBlock const *, unsigned> Numbers;
+  std::vector<unsigned> SCCOf;
+  std::vector<unsigned> SCCSize;
+  std::vector<BitVector> Closure;
+};
+
+/// new pass manager analysis
+class ReachabilityAnalysis : public AnalysisInfoMixin<ReachabilityAnalysis> {
+  friend AnalysisInfoMixin<ReachabilityAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  using Result = ReachabilityIndex;
+  Result run(Function &F, FunctionAnalysisManager &FAM);
+};
+
+/// legacy pass manager analysis, `AU.addRequired<ReachabilityWrapperPass>()`.
+/// Registered as CFG-only, so passes that setPreservesCFG() keep it alive
+/// and any other transformation drops it.
+class ReachabilityWrapperPass : public FunctionPass {
+ public:
+  static char ID;
+
+  ReachabilityWrapperPass() : FunctionPass(ID) {}
+
+  ReachabilityIndex &getIndex() { return *Index; }
+
+  bool runOnFunction(Function &F) override;
+  void releaseMemory() override { Index.reset(); }
+  void getAnalysisUsage(AnalysisUsage &AU) const override { AU.setPreservesAll(); }
+
+ private:
+  std::unique_ptr<ReachabilityIndex> Index;
+};
+
+}  // namespace llvm
+#endif
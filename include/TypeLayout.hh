@@ -0,0 +1,123 @@
+#ifndef TYPE_LAYOUT_HH
+#define TYPE_LAYOUT_HH
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Pass.h"
+
+#include <memory>
+#include <vector>
+
+namespace llvm {
+class DataLayout;
+class GEPOperator;
+class Module;
+class Type;
+
+/// what the DataLayout says about one type, sizes in bytes unless noted
+struct TypeLayout {
+  uint64_t SizeInBits = 0;
+  uint64_t StoreSize = 0;
+  uint64_t AllocSize = 0;
+  uint64_t Align = 1;
+  /// opaque structs, functions, labels... have no size at all
+  bool Sized = false;
+  /// scalable vectors, the sizes are the known minimum
+  bool Scalable = false;
+  unsigned FieldBegin = 0;
+  unsigned NumFields = 0;
+};
+
+/// Per-module cache of the DataLayout queries on types. Every type is
+/// laid out once, on its first query, and found again in a flat
+/// open-addressing table keyed by Type*; struct field offsets live back to
+/// back in one array. DataLayout keeps its own StructLayout map, but that
+/// one only covers structs and leaves every alloc size and alignment to be
+/// recomputed by walking the type.
+///
+/// Not thread-safe, a thread dumping or checking functions keeps its own.
+/// The caches of several threads still share the DataLayout, whose
+/// StructLayout map is filled on first use without a lock; they rely on
+/// layoutStructTypes having run on the main thread before.
+class TypeLayoutCache {
+ public:
+  explicit TypeLayoutCache(DataLayout const &DL);
+
+  DataLayout const &getDataLayout() const { return DL; }
+
+  TypeLayout const &get(Type const *T);
+
+  uint64_t getAllocSize(Type const *T) { return get(T).AllocSize; }
+  uint64_t getSizeInBits(Type const *T) { return get(T).SizeInBits; }
+  uint64_t getAlign(Type const *T) { return get(T).Align; }
+  /// byte offset of every element of a struct, empty for other types
+  ArrayRef<uint64_t> getFieldOffsets(Type const *T) {
+    auto &L = get(T);
+    return makeArrayRef(FieldOffsets).slice(L.FieldBegin, L.NumFields);
+  }
+
+  /// utils::getTypeSize, cached, except that a type with no size gives 0
+  /// (see TypeLayout::Sized) where utils::getTypeSize guesses 100
+  uint64_t getTypeSize(Type const *T);
+
+  /// byte offset a GEP adds to its pointer operand, None unless every index
+  /// is a scalar constant and every indexed type has a fixed size
+  Optional<int64_t> getGEPOffset(GEPOperator const &GEP);
+  /// the same over many GEPs, Offsets[i] for GEPs[i]; nested struct types
+  /// shared by the GEPs are laid out once
+  void getGEPOffsets(ArrayRef<GEPOperator const *> GEPs, MutableArrayRef<Optional<int64_t>> Offsets);
+
+  /// new pass manager hook, types never change under a module
+  bool invalidate(Module &M, PreservedAnalyses const &PA, ModuleAnalysisManager::Invalidator &Inv) { return false; }
+
+ private:
+  struct Slot {
+    Type const *Key = nullptr;
+    unsigned Layout = 0;
+  };
+
+  Slot &find(Type const *T);
+  void grow();
+
+  DataLayout const &DL;
+  /// power of two slots, at most 3/4 full
+  std::vector<Slot> Slots;
+  std::vector<TypeLayout> Layouts;
+  std::vector<uint64_t> FieldOffsets;
+};
+
+/// computes the StructLayout of every struct type M uses, literal ones
+/// included, so that later queries on M's DataLayout only read its map and
+/// can come from several threads
+void layoutStructTypes(Module const &M);
+
+/// new pass manager analysis
+class TypeLayoutAnalysis : public AnalysisInfoMixin<TypeLayoutAnalysis> {
+  friend AnalysisInfoMixin<TypeLayoutAnalysis>;
+  static AnalysisKey Key;
+
+ public:
+  using Result = TypeLayoutCache;
+  Result run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+/// legacy pass manager analysis, `AU.addRequired<TypeLayoutWrapperPass>()`
+class TypeLayoutWrapperPass : public ModulePass {
+ public:
+  static char ID;
+
+  TypeLayoutWrapperPass() : ModulePass(ID) {}
+
+  TypeLayoutCache &getCache() { return *Cache; }
+
+  bool runOnModule(Module &M) override;
+  void releaseMemory() override { Cache.reset(); }
+  void getAnalysisUsage(AnalysisUsage &AU) const override { AU.setPreservesAll(); }
+
+ private:
+  std::unique_ptr<TypeLayoutCache> Cache;
+};
+
+}  // namespace llvm
+#endif
@@ -0,0 +1,48 @@
+#ifndef TYPE_PROPERTIES_HH
+#define TYPE_PROPERTIES_HH
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+
+namespace llvm {
+class Function;
+class Instruction;
+class Type;
+class Value;
+
+/// what the checkers ask about a type, see TypePropertyCache
+struct TypeProps {
+  /// utils::isIntegerRelatedType
+  bool IntegerRelated = false;
+  /// a pointer, or a struct, array or vector holding one by value
+  bool ContainsPointer = false;
+  /// 0 for a non-pointer, 1 for T*, 2 for T**...
+  unsigned PointerDepth = 0;
+};
+
+/// utils::isIntegerRelatedType, isPointerValue and isPointerManipulation
+/// over a per-type memo: the properties of a type are computed once, from
+/// the already memoized properties of its element and pointee types. A type
+/// is entered in the memo before its elements are visited, so a cycle
+/// through a type still being computed ends on the conservative defaults
+/// instead of recursing forever.
+///
+/// Not thread-safe, every checker thread keeps its own.
+class TypePropertyCache {
+ public:
+  TypeProps const &get(Type const *T);
+
+  bool isIntegerRelatedType(Type const *T) { return get(T).IntegerRelated; }
+  bool isPointerValue(Value const *V);
+  bool isPointerManipulation(Instruction const *I);
+
+  /// the instructions of F for which isPointerManipulation holds, in
+  /// function order, from one scan over the function
+  void getPointerManipulations(Function const &F, SmallVectorImpl<Instruction const *> &Out);
+
+ private:
+  DenseMap<Type const *, TypeProps> Props;
+};
+
+}  // namespace llvm
+#endif
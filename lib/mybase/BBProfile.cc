@@ -0,0 +1,80 @@
+#include "BBProfile.hh"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace llvm {
+namespace bbprof {
+
+uint64_t functionHash(StringRef Name) {
+  return MD5Hash(Name);
+}
+
+uint64_t cfgChecksum(Function const &F) {
+  DenseMap<BasicBlock const *, uint32_t> index;
+  for (auto &B : F) index[&B] = index.size();
+
+  MD5 md5;
+  auto update = [&md5](uint32_t V) {
+    uint8_t bytes[4] = {uint8_t(V), uint8_t(V >> 8), uint8_t(V >> 16), uint8_t(V >> 24)};
+    md5.update(bytes);
+  };
+  update(F.size());
+  for (auto &B : F) {
+    update(B.getTerminator()->getNumSuccessors());
+    for (auto const *S : successors(&B)) update(index[S]);
+  }
+  MD5::MD5Result result;
+  md5.final(result);
+  return result.low();
+}
+
+Expected<ProfileView> readProfile(StringRef Buffer) {
+  auto malformed = [](char const *what) {
+    return createStringError(std::make_error_code(std::errc::invalid_argument), "malformed profile: %s", what);
+  };
+  if (Buffer.size() < sizeof(Header)) return malformed("truncated header");
+  if (reinterpret_cast<uintptr_t>(Buffer.data()) % alignof(uint64_t)) return malformed("unaligned buffer");
+
+  ProfileView view;
+  view.H = reinterpret_cast<Header const *>(Buffer.data());
+  if (view.H->Magic != k_magic) return malformed("bad magic");
+  if (view.H->Version != k_version)
+    return createStringError(std::make_error_code(std::errc::invalid_argument),
+                             "unsupported profile version %u", view.H->Version);
+
+  // sizes come from the file, every bound is checked by division so that a
+  // corrupt one cannot wrap around
+  uint64_t size = Buffer.size();
+  if (view.H->NumFunctions > (size - sizeof(Header)) / sizeof(FunctionRecord)) return malformed("truncated tables");
+  uint64_t fnEnd = sizeof(Header) + view.H->NumFunctions * sizeof(FunctionRecord);
+  if (view.H->CountersOffset < fnEnd || view.H->CountersOffset > size || view.H->CountersOffset % sizeof(uint64_t) ||
+      view.H->NumCounters > (size - view.H->CountersOffset) / sizeof(uint64_t))
+    return malformed("truncated tables");
+
+  view.Functions = makeArrayRef(reinterpret_cast<FunctionRecord const *>(view.H + 1), view.H->NumFunctions);
+  view.Counters = makeArrayRef(reinterpret_cast<uint64_t const *>(Buffer.data() + view.H->CountersOffset),
+                               view.H->NumCounters);
+  for (auto const &R : view.Functions) {
+    uint64_t numCounters = view.H->NumCounters;
+    if (R.CounterBase > numCounters || R.NumCounters > numCounters - R.CounterBase ||
+        R.PathCounterBase > numCounters || R.NumPathCounters > numCounters - R.PathCounterBase)
+      return malformed("counter slice out of range");
+  }
+  return view;
+}
+
+void writeProfile(raw_ostream &OS, uint32_t Mode, ArrayRef<FunctionRecord> Functions,
+                  ArrayRef<uint64_t> Counters) {
+  Header H{k_magic, k_version, Mode, Functions.size(), Counters.size(),
+           sizeof(Header) + Functions.size() * sizeof(FunctionRecord)};
+  OS.write(reinterpret_cast<char const *>(&H), sizeof(H));
+  OS.write(reinterpret_cast<char const *>(Functions.data()), Functions.size() * sizeof(FunctionRecord));
+  OS.write(reinterpret_cast<char const *>(Counters.data()), Counters.size() * sizeof(uint64_t));
+}
+
+}  // namespace bbprof
+}  // namespace llvm
@@ -0,0 +1,248 @@
+#include "Dataflow.hh"
+
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+
+namespace llvm {
+
+DataflowResult solveDataflow(Function const &F, DataflowProblem const &P) {
+  unsigned n = P.Gen.size();
+  assert(n == F.size() && "one transfer function per block");
+  bool forward = P.Dir == DataflowProblem::Forward;
+
+  // the CFG as arrays, Inputs are the blocks met into a block, Outputs the
+  // blocks to revisit once it changed
+  DenseMap<BasicBlock const *, unsigned> numbers;
+  std::vector<BasicBlock const *> blocks;
+  for (auto &B : F) {
+    numbers[&B] = blocks.size();
+    blocks.push_back(&B);
+  }
+  std::vector<unsigned> inBegin(n + 1), inputs, outBegin(n + 1), outputs;
+  auto &preds = forward ? inputs : outputs, &succs = forward ? outputs : inputs;
+  auto &predBegin = forward ? inBegin : outBegin, &succBegin = forward ? outBegin : inBegin;
+  for (unsigned b = 0; b < n; ++b) {
+    predBegin[b] = preds.size();
+    for (auto *Q : predecessors(blocks[b])) preds.push_back(numbers.lookup(Q));
+    succBegin[b] = succs.size();
+    for (auto *S : successors(blocks[b])) succs.push_back(numbers.lookup(S));
+  }
+  inBegin[n] = inputs.size();
+  outBegin[n] = outputs.size();
+
+  // reverse postorder along Outputs from the blocks without inputs, then
+  // from whatever is left, in function order
+  std::vector<unsigned> order, position(n, ~0U);
+  order.reserve(n);
+  {
+    std::vector<unsigned> post;
+    std::vector<std::pair<unsigned, unsigned>> dfs;
+    auto walk = [&](unsigned root) {
+      position[root] = 0;
+      dfs.emplace_back(root, outBegin[root]);
+      while (!dfs.empty()) {
+        auto &top = dfs.back();
+        if (top.second != outBegin[top.first + 1]) {
+          unsigned w = outputs[top.second++];
+          if (position[w] == ~0U) {
+            position[w] = 0;
+            dfs.emplace_back(w, outBegin[w]);
+          }
+          continue;
+        }
+        post.push_back(top.first);
+        dfs.pop_back();
+      }
+      order.insert(order.end(), post.rbegin(), post.rend());
+      post.clear();
+    };
+    for (unsigned b = 0; b < n; ++b) {
+      if (inBegin[b] == inBegin[b + 1] && position[b] == ~0U) walk(b);
+    }
+    for (unsigned b = 0; b < n; ++b) {
+      if (position[b] == ~0U) walk(b);
+    }
+    for (unsigned p = 0; p < n; ++p) position[order[p]] = p;
+  }
+
+  bool intersect = P.MeetOp == DataflowProblem::Intersect;
+  DataflowResult R;
+  R.In.assign(n, BitVector(P.NumBits, intersect));
+  R.Out.assign(n, BitVector(P.NumBits, intersect));
+  auto &meetSide = forward ? R.In : R.Out;
+  auto &transferSide = forward ? R.Out : R.In;
+
+  BitVector pending(n, true), scratch(P.NumBits);
+  while (pending.any()) {
+    for (int p = pending.find_first(); p != -1; p = pending.find_next(p)) {
+      pending.reset(p);
+      unsigned b = order[p];
+      BitVector &M = meetSide[b];
+      if (inBegin[b] == inBegin[b + 1]) {
+        M = P.Boundary;
+      } else {
+        M = transferSide[inputs[inBegin[b]]];
+        for (unsigned e = inBegin[b] + 1; e < inBegin[b + 1]; ++e) {
+          if (intersect) {
+            M &= transferSide[inputs[e]];
+          } else {
+            M |= transferSide[inputs[e]];
+          }
+        }
+      }
+      for (unsigned bit : P.MeetGen[b]) M.set(bit);
+
+      scratch = M;
+      for (auto &range : P.Kill[b]) scratch.reset(range.first, range.second);
+      for (unsigned bit : P.Gen[b]) scratch.set(bit);
+      if (scratch == transferSide[b]) continue;
+      std::swap(scratch, transferSide[b]);
+      for (unsigned e = outBegin[b]; e < outBegin[b + 1]; ++e) pending.set(position[outputs[e]]);
+    }
+  }
+  return R;
+}
+
+/// the variable S defines, nullptr if it stores through another pointer
+static Value const *getStoredVariable(StoreInst const *S) {
+  Value const *ptr = S->getPointerOperand()->stripPointerCasts();
+  return isa<AllocaInst>(ptr) || isa<GlobalVariable>(ptr) ? ptr : nullptr;
+}
+
+ReachingDefinitions::ReachingDefinitions(Function const &F) {
+  // group the stores by variable, variables in order of their first store
+  std::vector<Value const *> varOrder;
+  DenseMap<Value const *, std::vector<StoreInst const *>> stores;
+  unsigned numBlocks = 0;
+  for (auto &B : F) {
+    Blocks[&B] = numBlocks++;
+    for (auto &I : B) {
+      auto *S = dyn_cast<StoreInst>(&I);
+      if (!S) continue;
+      Value const *var = getStoredVariable(S);
+      if (!var) continue;
+      auto &list = stores[var];
+      if (list.empty()) varOrder.push_back(var);
+      list.push_back(S);
+    }
+  }
+  for (auto *var : varOrder) {
+    unsigned begin = Defs.size();
+    for (auto *S : stores[var]) {
+      DefNumbers[S] = Defs.size();
+      Defs.push_back(S);
+    }
+    Vars[var] = {begin, unsigned(Defs.size())};
+  }
+
+  DataflowProblem P(F.size(), Defs.size(), DataflowProblem::Forward, DataflowProblem::Union);
+  SmallDenseMap<Value const *, unsigned, 8> last;
+  unsigned b = 0;
+  for (auto &B : F) {
+    last.clear();
+    for (auto &I : B) {
+      if (auto *S = dyn_cast<StoreInst>(&I)) {
+        if (auto *var = getStoredVariable(S)) last[var] = DefNumbers.lookup(S);
+      }
+    }
+    for (auto &entry : last) {
+      P.Kill[b].push_back(Vars.lookup(entry.first));
+      P.Gen[b].push_back(entry.second);
+    }
+    ++b;
+  }
+  Result = solveDataflow(F, P);
+}
+
+Value const *ReachingDefinitions::getVariable(StoreInst const *S) const { return getStoredVariable(S); }
+
+void ReachingDefinitions::getReachingDefs(Instruction const *I, Value const *Var,
+                                          SmallVectorImpl<StoreInst const *> &Out) const {
+  auto it = Vars.find(Var);
+  if (it == Vars.end()) return;
+  BasicBlock const *B = I->getParent();
+  // the last store to Var before I in its block, if any, is the only one
+  StoreInst const *local = nullptr;
+  for (auto &J : *B) {
+    if (&J == I) break;
+    if (auto *S = dyn_cast<StoreInst>(&J)) {
+      if (getStoredVariable(S) == Var) local = S;
+    }
+  }
+  if (local) {
+    Out.push_back(local);
+    return;
+  }
+  BitVector const &in = getIn(B);
+  for (unsigned d = it->second.first; d < it->second.second; ++d) {
+    if (in.test(d)) Out.push_back(Defs[d]);
+  }
+}
+
+Liveness::Liveness(Function const &F) {
+  if (F.isDeclaration()) return;
+  unsigned numBlocks = 0;
+  for (auto &B : F) Blocks[&B] = numBlocks++;
+  BasicBlock const *entry = &F.getEntryBlock();
+  auto defBlock = [&](Value const *V) -> BasicBlock const * {
+    if (auto *I = dyn_cast<Instruction>(V)) return I->getParent();
+    return isa<Argument>(V) ? entry : nullptr;
+  };
+  // used outside of its block, phi uses count in the incoming block
+  auto crosses = [&](Value const *V) {
+    BasicBlock const *def = defBlock(V);
+    for (auto &U : V->uses()) {
+      auto *user = cast<Instruction>(U.getUser());
+      if (isa<PHINode>(user) || user->getParent() != def) return true;
+    }
+    return false;
+  };
+
+  // numbered block by block, so what a block defines is one range
+  std::vector<std::pair<unsigned, unsigned>> defRange(F.size());
+  for (auto &A : F.args()) {
+    if (crosses(&A)) {
+      Numbers[&A] = Values.size();
+      Values.push_back(&A);
+    }
+  }
+  unsigned b = 0;
+  for (auto &B : F) {
+    unsigned begin = &B == entry ? 0 : Values.size();
+    for (auto &I : B) {
+      if (!I.getType()->isVoidTy() && crosses(&I)) {
+        Numbers[&I] = Values.size();
+        Values.push_back(&I);
+      }
+    }
+    defRange[b++] = {begin, unsigned(Values.size())};
+  }
+
+  DataflowProblem P(F.size(), Values.size(), DataflowProblem::Backward, DataflowProblem::Union);
+  b = 0;
+  for (auto &B : F) {
+    if (defRange[b].first != defRange[b].second) P.Kill[b].push_back(defRange[b]);
+    for (auto &I : B) {
+      if (isa<PHINode>(I)) continue;
+      for (auto &op : I.operands()) {
+        auto it = Numbers.find(op.get());
+        if (it != Numbers.end() && defBlock(op.get()) != &B) P.Gen[b].push_back(it->second);
+      }
+    }
+    for (auto *S : successors(&B)) {
+      for (auto &phi : S->phis()) {
+        auto it = Numbers.find(phi.getIncomingValueForBlock(&B));
+        if (it != Numbers.end()) P.MeetGen[b].push_back(it->second);
+      }
+    }
+    ++b;
+  }
+  Result = solveDataflow(F, P);
+}
+
+AnalysisKey ReachingDefinitionsAnalysis::Key;
+AnalysisKey LivenessAnalysis::Key;
+
+}  // namespace llvm
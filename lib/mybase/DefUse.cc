@@ -0,0 +1,88 @@
+#include "DefUse.hh"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/InstIterator.h"
+
+namespace llvm {
+
+DefUseIndex::DefUseIndex(Function const &F) {
+  for (auto &A : F.args()) {
+    IDs[&A] = Values.size();
+    Values.push_back(&A);
+  }
+  for (auto &I : instructions(F)) {
+    IDs[&I] = Values.size();
+    Values.push_back(&I);
+  }
+
+  unsigned n = Values.size();
+  OperandBegin.reserve(n + 1);
+  UserBegin.assign(n + 1, 0);
+  for (unsigned v = 0; v < n; ++v) {
+    OperandBegin.push_back(OperandIDs.size());
+    auto *I = dyn_cast<Instruction>(Values[v]);
+    if (!I) continue;
+    for (auto &op : I->operands()) {
+      unsigned id = getID(op.get());
+      if (id == ~0U) continue;
+      OperandIDs.push_back(id);
+      ++UserBegin[id + 1];
+    }
+  }
+  OperandBegin.push_back(OperandIDs.size());
+
+  // user rows from the operand rows: prefix sums of the counts, then one
+  // pass placing every user, which keeps each row in function order
+  for (unsigned v = 0; v < n; ++v) UserBegin[v + 1] += UserBegin[v];
+  UserIDs.resize(OperandIDs.size());
+  std::vector<unsigned> fill(UserBegin.begin(), UserBegin.end() - 1);
+  for (unsigned v = 0; v < n; ++v) {
+    for (unsigned e = OperandBegin[v]; e < OperandBegin[v + 1]; ++e) UserIDs[fill[OperandIDs[e]]++] = v;
+  }
+}
+
+unsigned DefUseIndex::getID(Value const *V) const {
+  auto it = IDs.find(V);
+  return it == IDs.end() ? ~0U : it->second;
+}
+
+void DefUseIndex::slice(ArrayRef<unsigned> Seeds, BitVector &Slice, std::vector<unsigned> const &Begin,
+                        std::vector<unsigned> const &Edges) const {
+  Slice.resize(size());
+  std::vector<unsigned> worklist;
+  for (unsigned s : Seeds) {
+    if (Slice.test(s)) continue;
+    Slice.set(s);
+    worklist.push_back(s);
+  }
+  while (!worklist.empty()) {
+    unsigned v = worklist.back();
+    worklist.pop_back();
+    for (unsigned e = Begin[v]; e < Begin[v + 1]; ++e) {
+      unsigned w = Edges[e];
+      if (Slice.test(w)) continue;
+      Slice.set(w);
+      worklist.push_back(w);
+    }
+  }
+}
+
+void DefUseIndex::forwardSlice(ArrayRef<unsigned> Seeds, BitVector &Slice) const {
+  slice(Seeds, Slice, UserBegin, UserIDs);
+}
+
+void DefUseIndex::backwardSlice(ArrayRef<unsigned> Seeds, BitVector &Slice) const {
+  slice(Seeds, Slice, OperandBegin, OperandIDs);
+}
+
+AnalysisKey DefUseAnalysis::Key;
+
+bool DefUseWrapperPass::runOnFunction(Function &F) {
+  Index = std::make_unique<DefUseIndex>(F);
+  return false;
+}
+
+char DefUseWrapperPass::ID = 0;
+static RegisterPass<DefUseWrapperPass> X("def-use-index", "Def-use chains in compressed sparse rows", true, true);
+
+}  // namespace llvm
@@ -0,0 +1,83 @@
+#include "Demangler.hh"
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/StringSaver.h"
+#include "llvm/Support/ThreadPool.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cxxabi.h>
+
+namespace llvm {
+
+/// names demangled back to back by one task of demangleModule
+static size_t const k_namesPerTask = 4096;
+
+Demangler::~Demangler() { std::free(Buf); }
+
+char const *Demangler::demangleRaw(StringRef Mangled, std::string &Key, char *&Buf, size_t &BufSize) {
+  if (!Mangled.startswith("_Z")) return nullptr;
+  Key.assign(Mangled.begin(), Mangled.end());
+  int status;
+  char *ret = abi::__cxa_demangle(Key.c_str(), Buf, &BufSize, &status);
+  if (status != 0) return nullptr;
+  Buf = ret;
+  return ret;
+}
+
+StringRef Demangler::intern(StringRef Mangled, char const *Demangled) {
+  auto &E = *Names.try_emplace(Mangled).first;
+  E.second = Demangled ? StringSaver(Names.getAllocator()).save(StringRef(Demangled)) : E.getKey();
+  return E.second;
+}
+
+StringRef Demangler::demangle(StringRef Mangled) {
+  auto it = Names.find(Mangled);
+  if (it != Names.end()) return it->second;
+  return intern(Mangled, demangleRaw(Mangled, Key, Buf, BufSize));
+}
+
+void Demangler::demangleModule(Module const &M, unsigned NumThreads) {
+  std::vector<StringRef> todo;
+  auto add = [&](GlobalValue const &GV) {
+    if (GV.hasName() && !Names.count(GV.getName())) todo.push_back(GV.getName());
+  };
+  for (auto &F : M) add(F);
+  for (auto &GV : M.globals()) add(GV);
+  for (auto &GA : M.aliases()) add(GA);
+  if (todo.empty()) return;
+
+  // a task demangles into one string of null-terminated names, with the
+  // offset of each and ~0 for the names demangling to themselves
+  size_t numTasks = (todo.size() + k_namesPerTask - 1) / k_namesPerTask;
+  std::vector<std::string> results(numTasks);
+  std::vector<size_t> offsets(todo.size());
+  {
+    ThreadPool pool(hardware_concurrency(NumThreads));
+    for (size_t task = 0; task < numTasks; ++task) {
+      pool.async([&, task] {
+        std::string key, &out = results[task];
+        char *buf = nullptr;
+        size_t bufSize = 0;
+        size_t end = std::min(todo.size(), (task + 1) * k_namesPerTask);
+        for (size_t i = task * k_namesPerTask; i < end; ++i) {
+          if (char const *D = demangleRaw(todo[i], key, buf, bufSize)) {
+            offsets[i] = out.size();
+            out.append(D, std::strlen(D) + 1);
+          } else {
+            offsets[i] = ~size_t(0);
+          }
+        }
+        std::free(buf);
+      });
+    }
+    pool.wait();
+  }
+
+  for (size_t i = 0; i < todo.size(); ++i) {
+    auto &R = results[i / k_namesPerTask];
+    intern(todo[i], offsets[i] == ~size_t(0) ? nullptr : R.data() + offsets[i]);
+  }
+}
+
+}  // namespace llvm
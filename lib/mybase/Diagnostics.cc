@@ -0,0 +1,118 @@
+#include "Diagnostics.hh"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace llvm {
+namespace diag {
+
+namespace {
+
+/// a thread's buffer is handed to stderr once it holds this much
+size_t const k_flushThreshold = 8192;
+
+struct ThreadBuffer;
+
+/// the buffers of the live threads, and the lock serializing stderr
+struct Registry {
+  std::mutex Lock;
+  std::vector<ThreadBuffer *> Buffers;
+  std::mutex SinkLock;
+  std::atomic<uint64_t> Counts[RB_Diagnostics::FATAL + 1] = {};
+};
+
+Registry &getRegistry() {
+  static Registry R;
+  return R;
+}
+
+struct ThreadBuffer {
+  std::mutex Lock;
+  std::string Buf;
+
+  ThreadBuffer() {
+    auto &R = getRegistry();
+    std::lock_guard<std::mutex> G(R.Lock);
+    R.Buffers.push_back(this);
+  }
+
+  ~ThreadBuffer() {
+    auto &R = getRegistry();
+    std::lock_guard<std::mutex> G(R.Lock);
+    flush();
+    R.Buffers.erase(std::find(R.Buffers.begin(), R.Buffers.end(), this));
+  }
+
+  /// the caller does not hold Lock
+  void flush() {
+    std::lock_guard<std::mutex> G(Lock);
+    if (Buf.empty()) return;
+    {
+      std::lock_guard<std::mutex> S(getRegistry().SinkLock);
+      errs() << Buf;
+    }
+    Buf.clear();
+  }
+};
+
+ThreadBuffer &getThreadBuffer() {
+  static thread_local ThreadBuffer TB;
+  return TB;
+}
+
+}  // namespace
+
+bool stderrHasColors() {
+  static bool const colors = errs().has_colors();
+  return colors;
+}
+
+bool hasColors(raw_ostream &OS) {
+  // a file stream has colors enabled from the start, redirected or not
+  if (!OS.colors_enabled()) return false;
+  if (&OS == &errs()) return stderrHasColors();
+  if (OS.get_kind() == raw_ostream::OStreamKind::OK_FDStream) return OS.has_colors();
+  return true;
+}
+
+void emit(RB_Diagnostics level, StringRef msg) {
+  static char const *const prefixes[] = {"LOG: ", "WARN: ", "ERROR: ", "FATAL: "};
+  static raw_ostream::Colors const colors[] = {raw_ostream::CYAN, raw_ostream::YELLOW, raw_ostream::MAGENTA,
+                                               raw_ostream::RED};
+  getRegistry().Counts[level].fetch_add(1, std::memory_order_relaxed);
+
+  auto &TB = getThreadBuffer();
+  bool full;
+  {
+    std::lock_guard<std::mutex> G(TB.Lock);
+    raw_string_ostream OS(TB.Buf);
+    OS.enable_colors(stderrHasColors());
+    OS.changeColor(colors[level]);
+    OS << prefixes[level] << msg << "\n";
+    OS.resetColor();
+    OS.flush();
+    full = TB.Buf.size() >= k_flushThreshold;
+  }
+  if (level >= RB_Diagnostics::ERROR) {
+    flush();
+    abort();
+  }
+  if (full) TB.flush();
+}
+
+void flush() {
+  auto &R = getRegistry();
+  std::lock_guard<std::mutex> G(R.Lock);
+  for (auto *TB : R.Buffers) TB->flush();
+}
+
+uint64_t getCount(RB_Diagnostics level) { return getRegistry().Counts[level].load(std::memory_order_relaxed); }
+
+}  // namespace diag
+}  // namespace llvm
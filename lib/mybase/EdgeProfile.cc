@@ -0,0 +1,158 @@
+#include "EdgeProfile.hh"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace llvm {
+
+namespace {
+uint64_t const k_mustBeInTree = ~0ULL - 1;
+uint64_t const k_entryWeight = ~0ULL;
+
+struct UnionFind {
+  std::vector<unsigned> Parent;
+
+  explicit UnionFind(unsigned N) : Parent(N) {
+    std::iota(Parent.begin(), Parent.end(), 0);
+  }
+
+  unsigned find(unsigned X) {
+    while (Parent[X] != X) X = Parent[X] = Parent[Parent[X]];
+    return X;
+  }
+
+  bool join(unsigned A, unsigned B) {
+    A = find(A);
+    B = find(B);
+    if (A == B) return false;
+    Parent[A] = B;
+    return true;
+  }
+};
+}  // namespace
+
+EdgeProfilePlan::Placement EdgeProfilePlan::placementOf(BasicBlock const *Src, BasicBlock const *Dst) {
+  // parallel edges (e.g. switch cases sharing a target) are one edge
+  if (Src->getUniqueSuccessor() == Dst) return InSrc;
+  if (Dst->getUniquePredecessor() == Src && Dst->getFirstInsertionPt() != Dst->end()) return InDst;
+  return Split;
+}
+
+bool EdgeProfilePlan::canSplit(BasicBlock const *Src, BasicBlock const *Dst) {
+  auto const *TI = Src->getTerminator();
+  return !Dst->isEHPad() && !isa<IndirectBrInst>(TI) && !isa<CallBrInst>(TI);
+}
+
+EdgeProfilePlan::EdgeProfilePlan(Function &F) {
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+
+  DenseMap<BasicBlock const *, unsigned> index;
+  for (auto &B : F) {
+    index[&B] = Blocks.size();
+    Blocks.push_back(&B);
+  }
+
+  Edges.push_back({nullptr, &F.getEntryBlock(), k_entryWeight, InDst, -1});
+  for (auto *B : Blocks) {
+    auto *TI = B->getTerminator();
+    if (TI->getNumSuccessors() == 0) {
+      Edges.push_back({B, nullptr, 1, InSrc, -1});
+      continue;
+    }
+    SmallPtrSet<BasicBlock *, 4> seen;
+    for (auto *S : successors(B)) {
+      if (!seen.insert(S).second) continue;
+      // roughly how often the edge runs: 8x per loop level, back edges more
+      unsigned depth = std::min(LI.getLoopDepth(B), LI.getLoopDepth(S));
+      uint64_t weight = 1ULL << (3 * std::min(depth, 20u));
+      if (LI.isLoopHeader(S) && LI.getLoopFor(S)->contains(B)) weight *= 2;
+
+      Placement where = placementOf(B, S);
+      if (where == Split && !canSplit(B, S)) weight = k_mustBeInTree;
+      Edges.push_back({B, S, weight, where, -1});
+    }
+  }
+
+  // Kruskal, heaviest first; ties keep function order so the plan is stable
+  std::vector<unsigned> order(Edges.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [this](unsigned A, unsigned B) { return Edges[A].Weight > Edges[B].Weight; });
+  UnionFind components(Blocks.size() + 1);
+  std::vector<bool> inTree(Edges.size());
+  for (unsigned i : order) {
+    unsigned src = Edges[i].Src ? index[Edges[i].Src] : Blocks.size();
+    unsigned dst = Edges[i].Dst ? index[Edges[i].Dst] : Blocks.size();
+    inTree[i] = components.join(src, dst);
+    if (!inTree[i] && Edges[i].Weight == k_mustBeInTree) Valid = false;
+  }
+  // counter slots follow edge order rather than Kruskal order
+  for (unsigned i = 0; i < Edges.size(); ++i) {
+    if (!inTree[i]) Edges[i].Counter = NumCounters++;
+  }
+}
+
+void EdgeProfilePlan::reconstruct(ArrayRef<uint64_t> Counters, std::vector<uint64_t> &EdgeCounts,
+                                  DenseMap<BasicBlock const *, uint64_t> &BlockCounts) const {
+  unsigned numNodes = Blocks.size() + 1;
+  DenseMap<BasicBlock const *, unsigned> index;
+  for (unsigned i = 0; i < Blocks.size(); ++i) index[Blocks[i]] = i;
+  auto nodeOf = [&](BasicBlock const *B) { return B ? index[B] : Blocks.size(); };
+
+  // per node: known inflow minus known outflow, and the unknown tree edges
+  std::vector<int64_t> balance(numNodes, 0);
+  std::vector<SmallVector<unsigned, 4>> unknown(numNodes);
+  std::vector<int64_t> counts(Edges.size(), 0);
+  std::vector<bool> known(Edges.size(), false);
+  for (unsigned i = 0; i < Edges.size(); ++i) {
+    Edge const &E = Edges[i];
+    unsigned src = nodeOf(E.Src), dst = nodeOf(E.Dst);
+    if (E.Counter >= 0) {
+      counts[i] = E.Counter < (int)Counters.size() ? Counters[E.Counter] : 0;
+      known[i] = true;
+      balance[dst] += counts[i];
+      balance[src] -= counts[i];
+    } else {
+      unknown[src].push_back(i);
+      unknown[dst].push_back(i);
+    }
+  }
+
+  // peel the leaves of the tree: a node with one unknown edge left fixes it
+  SmallVector<unsigned, 16> worklist;
+  for (unsigned n = 0; n < numNodes; ++n) {
+    if (unknown[n].size() == 1) worklist.push_back(n);
+  }
+  while (!worklist.empty()) {
+    unsigned n = worklist.pop_back_val();
+    auto it = find_if(unknown[n], [&](unsigned e) { return !known[e]; });
+    if (it == unknown[n].end()) continue;
+    unsigned e = *it;
+    unsigned src = nodeOf(Edges[e].Src), dst = nodeOf(Edges[e].Dst);
+    counts[e] = dst == n ? -balance[n] : balance[n];
+    known[e] = true;
+    balance[dst] += counts[e];
+    balance[src] -= counts[e];
+    unsigned other = dst == n ? src : dst;
+    if (count_if(unknown[other], [&](unsigned x) { return !known[x]; }) == 1) worklist.push_back(other);
+  }
+
+  // a program leaving through exit() or longjmp breaks conservation, clamp
+  EdgeCounts.assign(Edges.size(), 0);
+  BlockCounts.clear();
+  for (auto *B : Blocks) BlockCounts[B] = 0;
+  for (unsigned i = 0; i < Edges.size(); ++i) {
+    EdgeCounts[i] = counts[i] > 0 ? counts[i] : 0;
+    if (Edges[i].Dst) BlockCounts[Edges[i].Dst] += EdgeCounts[i];
+  }
+}
+
+}  // namespace llvm
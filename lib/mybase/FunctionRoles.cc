@@ -0,0 +1,71 @@
+#include "FunctionRoles.hh"
+
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/Module.h"
+
+namespace llvm {
+
+unsigned FunctionRoleIndex::classify(Function const &F) {
+  switch (F.getIntrinsicID()) {
+    case Intrinsic::memcpy:
+    case Intrinsic::memmove:
+    case Intrinsic::memset: return k_roleMemIntrinsic;
+    case Intrinsic::not_intrinsic: break;
+    default: return 0;
+  }
+  if (!F.isDeclaration() || !F.hasName()) return 0;
+  return StringSwitch<unsigned>(F.getName())
+      .Case("malloc", k_roleAllocator)
+      .Case("free", k_roleDeallocator)
+      .Case("__assert_fail", k_roleAssert)
+      .Cases("exit", "_exit", "_Exit", "abort", k_roleExit)
+      .Default(0);
+}
+
+FunctionRoleIndex::FunctionRoleIndex(Module &M) {
+  for (auto &F : M) {
+    if (unsigned roles = classify(F)) Roles[&F] = roles;
+  }
+  if (Roles.empty()) return;
+
+  for (auto &F : M) {
+    unsigned begins[k_numFnRoles];
+    for (unsigned r = 0; r < k_numFnRoles; ++r) begins[r] = Sites[r].size();
+    for (auto &B : F) {
+      for (auto &I : B) {
+        auto *CI = dyn_cast<CallInst>(&I);
+        if (!CI) continue;
+        unsigned roles = getRoles(CI->getCalledFunction());
+        for (; roles; roles &= roles - 1) Sites[countTrailingZeros(roles)].push_back(CI);
+      }
+    }
+    for (unsigned r = 0; r < k_numFnRoles; ++r) {
+      if (Sites[r].size() != begins[r]) CallerSites[r][&F] = {begins[r], Sites[r].size()};
+    }
+  }
+}
+
+ArrayRef<CallInst *> FunctionRoleIndex::getCallSites(FnRole R, Function const *Caller) const {
+  unsigned r = roleNumber(R);
+  auto it = CallerSites[r].find(Caller);
+  if (it == CallerSites[r].end()) return {};
+  return makeArrayRef(Sites[r]).slice(it->second.first, it->second.second - it->second.first);
+}
+
+AnalysisKey FunctionRoleAnalysis::Key;
+
+FunctionRoleIndex FunctionRoleAnalysis::run(Module &M, ModuleAnalysisManager &MAM) {
+  return FunctionRoleIndex(M);
+}
+
+bool FunctionRoleWrapperPass::runOnModule(Module &M) {
+  Index = std::make_unique<FunctionRoleIndex>(M);
+  return false;
+}
+
+char FunctionRoleWrapperPass::ID = 0;
+static RegisterPass<FunctionRoleWrapperPass> X("function-roles", "Function role and call site index", false, true);
+
+}  // namespace llvm
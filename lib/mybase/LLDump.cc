@@ -2,6 +2,7 @@
 
 #include "LLDump.hh"
 
+#include <array>
 #include <string>
 
 #include "llvm/IR/Instruction.h"
@@ -13,18 +14,6 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 
-#define INST_KIND_DUMP(err, stop, Key)  \
-  {                                     \
-    if (Key) err << InstTypeStr(#Key);  \
-    {                                   \
-      if (Key && stop) {                \
-        err << "\n";                    \
-        break;                          \
-      }                                 \
-      if (Key && !stop) err << " <-- "; \
-    }                                   \
-  }
-
 namespace llvm {
 
 #define casePrint(Key) \
@@ -32,6 +21,8 @@ namespace llvm {
     return std::string(#Key);  \
 
 std::string getValueStr(Value const *v) {
+  // instructions take every value id from InstructionVal on
+  if (isa<Instruction>(v)) return "Value::InstructionVal";
   switch (v->getValueID()) {
     casePrint(Value::ArgumentVal);
     casePrint(Value::BasicBlockVal);
@@ -87,98 +78,149 @@ std::string getTypeStr(Type const *type) {
   }
 }
 
-void printInstKind(Instruction const &I) {
-  errs() << "\n" << I << "\n";
-  while (true) {
-    /// INST_KIND_DUMP(errs(), true, isa<AtomicRMWInst>(I));
-    /// INST_KIND_DUMP(errs(), true, isa<AtomicCmpXchgInst>(I));
-    INST_KIND_DUMP(errs(), true, isa<BinaryOperator>(I));
-    INST_KIND_DUMP(errs(), false, isa<CallInst>(I));
-    {
-      if (auto *CI = dyn_cast<CallInst>(&I)) {
-        if (CI->isInlineAsm()) {
-          errs() << "InlineAsm\n";
-          break;
-        }
-        INST_KIND_DUMP(errs(), false, isa<IntrinsicInst>(I));
-        {
-          INST_KIND_DUMP(errs(), false, isa<DbgInfoIntrinsic>(I));
-          {
-            INST_KIND_DUMP(errs(), true, isa<DbgValueInst>(I));
-            INST_KIND_DUMP(errs(), true, isa<DbgDeclareInst>(I));
-          }
-          INST_KIND_DUMP(errs(), false, isa<MemIntrinsic>(I));
-          {
-            INST_KIND_DUMP(errs(), false, isa<MemSetInst>(I));
-            INST_KIND_DUMP(errs(), true, isa<MemTransferInst>(I));
-            INST_KIND_DUMP(errs(), true, isa<MemCpyInst>(I));
-          }
-          INST_KIND_DUMP(errs(), true, isa<VACopyInst>(I));
-          INST_KIND_DUMP(errs(), true, isa<VAEndInst>(I));
-          INST_KIND_DUMP(errs(), true, isa<VAStartInst>(I));
-        }
-        errs() << "[Simple CallInst]\n";
-        break;
-      }
-    }
-    INST_KIND_DUMP(errs(), false, isa<CmpInst>(I));
-    {
-      INST_KIND_DUMP(errs(), true, isa<ICmpInst>(I));
-      INST_KIND_DUMP(errs(), true, isa<FCmpInst>(I));
-    }
-    INST_KIND_DUMP(errs(), true, isa<ExtractElementInst>(I));
-    /// INST_KIND_DUMP(errs(), true, isa<FenceInst>(I));
-    INST_KIND_DUMP(errs(), true, isa<GetElementPtrInst>(I));
-    INST_KIND_DUMP(errs(), true, isa<InsertValueInst>(I));
-    /// INST_KIND_DUMP(errs(), true, isa<LandingPadInst>(I));
-    INST_KIND_DUMP(errs(), true, isa<PHINode>(I));
-    INST_KIND_DUMP(errs(), true, isa<SelectInst>(I));
-    INST_KIND_DUMP(errs(), true, isa<ShuffleVectorInst>(I));
-    INST_KIND_DUMP(errs(), true, isa<StoreInst>(I));
-    // INST_KIND_DUMP(errs(), false, isa<TerminatorInst>(I));
-    {
-      INST_KIND_DUMP(errs(), true, isa<BranchInst>(I));
-      INST_KIND_DUMP(errs(), true, isa<IndirectBrInst>(I));
-      INST_KIND_DUMP(errs(), true, isa<InvokeInst>(I));
-      /// INST_KIND_DUMP(errs(), true, isa<ResumeInst>(I));
-      INST_KIND_DUMP(errs(), true, isa<ReturnInst>(I));
-      INST_KIND_DUMP(errs(), true, isa<SwitchInst>(I));
-      INST_KIND_DUMP(errs(), true, isa<UnreachableInst>(I));
-    }
-    INST_KIND_DUMP(errs(), false, isa<UnaryInstruction>(I));
-    {
-      INST_KIND_DUMP(errs(), true, isa<AllocaInst const>(I));
-      INST_KIND_DUMP(errs(), true, isa<CastInst>(I));
-      {
-        INST_KIND_DUMP(errs(), true, isa<BitCastInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<FPExtInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<FPToSIInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<FPToUIInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<FPTruncInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<IntToPtrInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<PtrToIntInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<SExtInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<SIToFPInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<TruncInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<UIToFPInst>(I));
-        INST_KIND_DUMP(errs(), true, isa<ZExtInst>(I));
-      }
-      INST_KIND_DUMP(errs(), true, isa<ExtractValueInst>(I));
-      INST_KIND_DUMP(errs(), true, isa<LoadInst>(I));
-      INST_KIND_DUMP(errs(), true, isa<VAArgInst>(I));
+namespace {
+#define CALL_KIND "CallBase <-- CallInst"
+#define INTRINSIC_KIND CALL_KIND " <-- IntrinsicInst"
+
+/// class-hierarchy path below Instruction of the class an opcode stands for
+constexpr StringLiteral opcodeKind(unsigned Opcode) {
+  switch (Opcode) {
+    case Instruction::Ret: return "ReturnInst";
+    case Instruction::Br: return "BranchInst";
+    case Instruction::Switch: return "SwitchInst";
+    case Instruction::IndirectBr: return "IndirectBrInst";
+    case Instruction::Invoke: return "CallBase <-- InvokeInst";
+    case Instruction::Resume: return "ResumeInst";
+    case Instruction::Unreachable: return "UnreachableInst";
+    case Instruction::CleanupRet: return "CleanupReturnInst";
+    case Instruction::CatchRet: return "CatchReturnInst";
+    case Instruction::CatchSwitch: return "CatchSwitchInst";
+    case Instruction::CallBr: return "CallBase <-- CallBrInst";
+    case Instruction::FNeg: return "UnaryInstruction <-- UnaryOperator";
+#define HANDLE_BINARY_INST(N, OPC, CLASS) case Instruction::OPC:
+#include "llvm/IR/Instruction.def"
+      return "BinaryOperator";
+    case Instruction::Alloca: return "UnaryInstruction <-- AllocaInst";
+    case Instruction::Load: return "UnaryInstruction <-- LoadInst";
+    case Instruction::Store: return "StoreInst";
+    case Instruction::GetElementPtr: return "GetElementPtrInst";
+    case Instruction::Fence: return "FenceInst";
+    case Instruction::AtomicCmpXchg: return "AtomicCmpXchgInst";
+    case Instruction::AtomicRMW: return "AtomicRMWInst";
+    case Instruction::Trunc: return "UnaryInstruction <-- CastInst <-- TruncInst";
+    case Instruction::ZExt: return "UnaryInstruction <-- CastInst <-- ZExtInst";
+    case Instruction::SExt: return "UnaryInstruction <-- CastInst <-- SExtInst";
+    case Instruction::FPToUI: return "UnaryInstruction <-- CastInst <-- FPToUIInst";
+    case Instruction::FPToSI: return "UnaryInstruction <-- CastInst <-- FPToSIInst";
+    case Instruction::UIToFP: return "UnaryInstruction <-- CastInst <-- UIToFPInst";
+    case Instruction::SIToFP: return "UnaryInstruction <-- CastInst <-- SIToFPInst";
+    case Instruction::FPTrunc: return "UnaryInstruction <-- CastInst <-- FPTruncInst";
+    case Instruction::FPExt: return "UnaryInstruction <-- CastInst <-- FPExtInst";
+    case Instruction::PtrToInt: return "UnaryInstruction <-- CastInst <-- PtrToIntInst";
+    case Instruction::IntToPtr: return "UnaryInstruction <-- CastInst <-- IntToPtrInst";
+    case Instruction::BitCast: return "UnaryInstruction <-- CastInst <-- BitCastInst";
+    case Instruction::AddrSpaceCast: return "UnaryInstruction <-- CastInst <-- AddrSpaceCastInst";
+    case Instruction::CleanupPad: return "FuncletPadInst <-- CleanupPadInst";
+    case Instruction::CatchPad: return "FuncletPadInst <-- CatchPadInst";
+    case Instruction::ICmp: return "CmpInst <-- ICmpInst";
+    case Instruction::FCmp: return "CmpInst <-- FCmpInst";
+    case Instruction::PHI: return "PHINode";
+    case Instruction::Call: return CALL_KIND;
+    case Instruction::Select: return "SelectInst";
+    case Instruction::UserOp1: return "UserOp1";
+    case Instruction::UserOp2: return "UserOp2";
+    case Instruction::VAArg: return "UnaryInstruction <-- VAArgInst";
+    case Instruction::ExtractElement: return "ExtractElementInst";
+    case Instruction::InsertElement: return "InsertElementInst";
+    case Instruction::ShuffleVector: return "ShuffleVectorInst";
+    case Instruction::ExtractValue: return "UnaryInstruction <-- ExtractValueInst";
+    case Instruction::InsertValue: return "InsertValueInst";
+    case Instruction::LandingPad: return "LandingPadInst";
+    case Instruction::Freeze: return "UnaryInstruction <-- FreezeInst";
+  }
+  return "";
+}
+
+constexpr std::array<StringRef, Instruction::OtherOpsEnd> makeOpcodeKinds() {
+  std::array<StringRef, Instruction::OtherOpsEnd> kinds{};
+  for (unsigned op = 0; op < kinds.size(); ++op) kinds[op] = opcodeKind(op);
+  return kinds;
+}
+
+/// printInstKind's answer by opcode, built by the compiler
+constexpr std::array<StringRef, Instruction::OtherOpsEnd> k_opcodeKinds = makeOpcodeKinds();
+
+constexpr bool allOpcodesHaveKind() {
+#define HANDLE_INST(N, OPC, CLASS) \
+  if (k_opcodeKinds[N].empty()) return false;
+#include "llvm/IR/Instruction.def"
+  return true;
+}
+static_assert(allOpcodesHaveKind(), "an opcode of Instruction.def is missing in opcodeKind");
+
+/// the intrinsics with a class of their own in IntrinsicInst.h
+StringRef intrinsicKind(Intrinsic::ID ID) {
+  switch (ID) {
+    case Intrinsic::dbg_declare: return INTRINSIC_KIND " <-- DbgInfoIntrinsic <-- DbgVariableIntrinsic <-- DbgDeclareInst";
+    case Intrinsic::dbg_value: return INTRINSIC_KIND " <-- DbgInfoIntrinsic <-- DbgVariableIntrinsic <-- DbgValueInst";
+    case Intrinsic::dbg_addr: return INTRINSIC_KIND " <-- DbgInfoIntrinsic <-- DbgVariableIntrinsic <-- DbgAddrIntrinsic";
+    case Intrinsic::dbg_label: return INTRINSIC_KIND " <-- DbgInfoIntrinsic <-- DbgLabelInst";
+    case Intrinsic::memset: return INTRINSIC_KIND " <-- MemIntrinsic <-- MemSetInst";
+    case Intrinsic::memcpy: return INTRINSIC_KIND " <-- MemIntrinsic <-- MemTransferInst <-- MemCpyInst";
+    case Intrinsic::memcpy_inline:
+      return INTRINSIC_KIND " <-- MemIntrinsic <-- MemTransferInst <-- MemCpyInst <-- MemCpyInlineInst";
+    case Intrinsic::memmove: return INTRINSIC_KIND " <-- MemIntrinsic <-- MemTransferInst <-- MemMoveInst";
+    case Intrinsic::memset_element_unordered_atomic: return INTRINSIC_KIND " <-- AtomicMemIntrinsic <-- AtomicMemSetInst";
+    case Intrinsic::memcpy_element_unordered_atomic:
+      return INTRINSIC_KIND " <-- AtomicMemIntrinsic <-- AtomicMemTransferInst <-- AtomicMemCpyInst";
+    case Intrinsic::memmove_element_unordered_atomic:
+      return INTRINSIC_KIND " <-- AtomicMemIntrinsic <-- AtomicMemTransferInst <-- AtomicMemMoveInst";
+    case Intrinsic::vastart: return INTRINSIC_KIND " <-- VAStartInst";
+    case Intrinsic::vaend: return INTRINSIC_KIND " <-- VAEndInst";
+    case Intrinsic::vacopy: return INTRINSIC_KIND " <-- VACopyInst";
+    case Intrinsic::assume: return INTRINSIC_KIND " <-- AssumeInst";
+    case Intrinsic::smax:
+    case Intrinsic::smin:
+    case Intrinsic::umax:
+    case Intrinsic::umin: return INTRINSIC_KIND " <-- MinMaxIntrinsic";
+    case Intrinsic::sadd_with_overflow:
+    case Intrinsic::uadd_with_overflow:
+    case Intrinsic::ssub_with_overflow:
+    case Intrinsic::usub_with_overflow:
+    case Intrinsic::smul_with_overflow:
+    case Intrinsic::umul_with_overflow: return INTRINSIC_KIND " <-- BinaryOpIntrinsic <-- WithOverflowInst";
+    case Intrinsic::sadd_sat:
+    case Intrinsic::uadd_sat:
+    case Intrinsic::ssub_sat:
+    case Intrinsic::usub_sat: return INTRINSIC_KIND " <-- BinaryOpIntrinsic <-- SaturatingInst";
+#define CMP_INSTRUCTION(N, A, R, I, D) case Intrinsic::I:
+#define INSTRUCTION(N, A, R, I)
+#include "llvm/IR/ConstrainedOps.def"
+      return INTRINSIC_KIND " <-- ConstrainedFPIntrinsic <-- ConstrainedFPCmpIntrinsic";
+#define CMP_INSTRUCTION(N, A, R, I, D)
+#define INSTRUCTION(N, A, R, I) case Intrinsic::I:
+#include "llvm/IR/ConstrainedOps.def"
+      return INTRINSIC_KIND " <-- ConstrainedFPIntrinsic";
+    default: return INTRINSIC_KIND;
+  }
+}
+}  // namespace
+
+StringRef getInstKindStr(Instruction const &I) {
+  if (auto *CI = dyn_cast<CallInst>(&I)) {
+    if (CI->isInlineAsm()) return CALL_KIND " <-- InlineAsm";
+    // what isa<IntrinsicInst> checks
+    if (auto *F = CI->getCalledFunction()) {
+      if (F->isIntrinsic()) return intrinsicKind(F->getIntrinsicID());
     }
-    std::string instStr;
-    raw_string_ostream OS(instStr);
-    OS << "unknown Instruction Type\n";
-    rbscope_diagnostics(RB_Diagnostics::FATAL, OS.str().c_str());
   }
+  return k_opcodeKinds[I.getOpcode()];
 }
+#undef INTRINSIC_KIND
+#undef CALL_KIND
 
-std::string InstTypeStr(char const *instTypeChars) {
-  std::string instTypeString(instTypeChars);
-  auto typeBegIndex = instTypeString.find("isa<") + 4;
-  auto typeEndIndex = instTypeString.find(">");
-  return instTypeString.substr(typeBegIndex, typeEndIndex - typeBegIndex);
+void printInstKind(Instruction const &I, raw_ostream &OS) {
+  OS << "\n" << I << "\n" << getInstKindStr(I) << "\n";
 }
 
 void prettyPrint(Value const *V, unsigned endLine, unsigned startLine) {
@@ -218,10 +260,10 @@ void prettyPrint(Value const *V, unsigned endLine, unsigned startLine) {
   while (endLine--) errs() << "\n";
 }
 
-void dumpLinkageType(GlobalValue &GV) {
+void dumpLinkageType(GlobalValue &GV, raw_ostream &OS) {
   GlobalValue::LinkageTypes lty = GV.getLinkage();
 #define dumpLTYInfo(key, lty) \
-  errs() << #key << "=" << GlobalValue::is##key(lty) << "; "
+  OS << #key << "=" << GlobalValue::is##key(lty) << "; "
 
 #define LIST                                                                \
   X(ExternalLinkage)                                                        \
@@ -236,10 +278,10 @@ void dumpLinkageType(GlobalValue &GV) {
 #undef X
 }
 
-void dumpGVInfo(GlobalValue &GV) {
-  errs() << "isMaterializable: " << GV.isMaterializable() << "; ";
-  dumpLinkageType(GV);
-  errs() << "\n";
+void dumpGVInfo(GlobalValue &GV, raw_ostream &OS) {
+  OS << "isMaterializable: " << GV.isMaterializable() << "; ";
+  dumpLinkageType(GV, OS);
+  OS << "\n";
 }
 
 void dumpPassKind(llvm::PassKind kind) {
@@ -249,6 +249,11 @@ bool isIntegerRelatedType(Type const *ty) {
   return isa<IntegerType>(ty);  // int
 }
 
+/// one-shot, a pass asking for many types keeps a TypeLayoutCache
+unsigned getTypeSize(DataLayout const &targetData, Type const *type) {
+  return detail::getTypeSize(targetData, const_cast<Type *>(type));
+}
+
 /// -----------------------------------------------------
 
 SmallVector<CallInst *, 4> getAssertCallSite(Function *func) {
@@ -0,0 +1,258 @@
+#include "LoopCost.hh"
+
+#include "LoopNest.hh"
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <array>
+#include <tuple>
+
+namespace llvm {
+
+namespace {
+/// latency of an opcode in cycles, ~0U for the calls, see getInstLatency
+constexpr unsigned opcodeLatency(unsigned Opcode) {
+  switch (Opcode) {
+    case Instruction::PHI:
+    case Instruction::Alloca:
+    case Instruction::BitCast:
+    case Instruction::AddrSpaceCast:
+    case Instruction::PtrToInt:
+    case Instruction::IntToPtr:
+    case Instruction::Freeze:
+    case Instruction::Unreachable:
+    case Instruction::UserOp1:
+    case Instruction::UserOp2: return 0;
+    case Instruction::Add:
+    case Instruction::Sub:
+    case Instruction::And:
+    case Instruction::Or:
+    case Instruction::Xor:
+    case Instruction::Shl:
+    case Instruction::LShr:
+    case Instruction::AShr:
+    case Instruction::ICmp:
+    case Instruction::Select:
+    case Instruction::Trunc:
+    case Instruction::ZExt:
+    case Instruction::SExt:
+    case Instruction::GetElementPtr:
+    case Instruction::ExtractValue:
+    case Instruction::InsertValue:
+    case Instruction::Br:
+    case Instruction::Ret:
+    case Instruction::Store: return 1;
+    case Instruction::Switch:
+    case Instruction::IndirectBr:
+    case Instruction::FNeg: return 2;
+    case Instruction::Mul:
+    case Instruction::FCmp:
+    case Instruction::ExtractElement:
+    case Instruction::InsertElement:
+    case Instruction::ShuffleVector: return 3;
+    case Instruction::FAdd:
+    case Instruction::FSub:
+    case Instruction::FMul:
+    case Instruction::FPTrunc:
+    case Instruction::FPExt:
+    case Instruction::FPToUI:
+    case Instruction::FPToSI:
+    case Instruction::UIToFP:
+    case Instruction::SIToFP:
+    case Instruction::Load: return 4;
+    case Instruction::FDiv: return 15;
+    case Instruction::AtomicCmpXchg:
+    case Instruction::AtomicRMW: return 20;
+    case Instruction::UDiv:
+    case Instruction::SDiv:
+    case Instruction::URem:
+    case Instruction::SRem:
+    case Instruction::FRem:
+    case Instruction::Fence:
+    case Instruction::VAArg: return 25;
+    case Instruction::Call:
+    case Instruction::Invoke:
+    case Instruction::CallBr: return ~0U;
+    case Instruction::Resume:
+    case Instruction::CleanupRet:
+    case Instruction::CatchRet:
+    case Instruction::CatchSwitch:
+    case Instruction::CleanupPad:
+    case Instruction::CatchPad:
+    case Instruction::LandingPad: return 50;
+  }
+  return ~1U;
+}
+
+constexpr std::array<unsigned, Instruction::OtherOpsEnd> makeOpcodeLatencies() {
+  std::array<unsigned, Instruction::OtherOpsEnd> latencies{};
+  for (unsigned op = 0; op < latencies.size(); ++op) latencies[op] = opcodeLatency(op);
+  return latencies;
+}
+
+/// getInstLatency's answer by opcode, built by the compiler
+constexpr std::array<unsigned, Instruction::OtherOpsEnd> k_opcodeLatencies = makeOpcodeLatencies();
+
+constexpr bool allOpcodesHaveLatency() {
+#define HANDLE_INST(N, OPC, CLASS) \
+  if (k_opcodeLatencies[N] == ~1U) return false;
+#include "llvm/IR/Instruction.def"
+  return true;
+}
+static_assert(allOpcodesHaveLatency(), "an opcode of Instruction.def is missing in opcodeLatency");
+
+/// the intrinsics that are a few instructions at most
+unsigned intrinsicLatency(Intrinsic::ID ID) {
+  switch (ID) {
+    case Intrinsic::dbg_declare:
+    case Intrinsic::dbg_value:
+    case Intrinsic::dbg_addr:
+    case Intrinsic::dbg_label:
+    case Intrinsic::lifetime_start:
+    case Intrinsic::lifetime_end:
+    case Intrinsic::assume:
+    case Intrinsic::expect: return 0;
+    case Intrinsic::smax:
+    case Intrinsic::smin:
+    case Intrinsic::umax:
+    case Intrinsic::umin:
+    case Intrinsic::abs:
+    case Intrinsic::ctpop:
+    case Intrinsic::ctlz:
+    case Intrinsic::cttz:
+    case Intrinsic::bswap:
+    case Intrinsic::fshl:
+    case Intrinsic::fshr:
+    case Intrinsic::sadd_with_overflow:
+    case Intrinsic::uadd_with_overflow:
+    case Intrinsic::ssub_with_overflow:
+    case Intrinsic::usub_with_overflow:
+    case Intrinsic::sadd_sat:
+    case Intrinsic::uadd_sat:
+    case Intrinsic::ssub_sat:
+    case Intrinsic::usub_sat: return 1;
+    case Intrinsic::smul_with_overflow:
+    case Intrinsic::umul_with_overflow:
+    case Intrinsic::fabs:
+    case Intrinsic::copysign:
+    case Intrinsic::minnum:
+    case Intrinsic::maxnum: return 3;
+    case Intrinsic::fma:
+    case Intrinsic::fmuladd:
+    case Intrinsic::floor:
+    case Intrinsic::ceil:
+    case Intrinsic::trunc:
+    case Intrinsic::rint:
+    case Intrinsic::nearbyint:
+    case Intrinsic::round: return 4;
+    case Intrinsic::sqrt: return 15;
+    default: return k_callLatency;
+  }
+}
+}  // namespace
+
+unsigned getInstLatency(Instruction const &I) {
+  unsigned latency = k_opcodeLatencies[I.getOpcode()];
+  if (latency != ~0U) return latency;
+  if (auto *II = dyn_cast<IntrinsicInst>(&I)) return intrinsicLatency(II->getIntrinsicID());
+  return k_callLatency;
+}
+
+std::vector<LoopCost> computeLoopCosts(LoopNestReport const &Report, uint64_t UnknownTrips) {
+  ArrayRef<LoopRecord> loops = Report.loops();
+  std::vector<LoopCost> costs(loops.size());
+  // preorder, the parents come first
+  for (size_t i = 0; i < loops.size(); ++i) {
+    LoopRecord const &R = loops[i];
+    LoopCost &C = costs[i];
+    for (auto *B : R.L->blocks()) {
+      if (any_of(R.L->getSubLoops(), [&](Loop const *S) { return S->contains(B); })) continue;
+      for (auto &I : *B) C.IterLatency += getInstLatency(I);
+    }
+    if (R.ConstBackedgeTaken) {
+      C.Trips = SaturatingAdd(*R.ConstBackedgeTaken, uint64_t(1));
+      C.TripsKnown = true;
+    } else if (R.MaxBackedgeTaken) {
+      C.Trips = std::min(SaturatingAdd(*R.MaxBackedgeTaken, uint64_t(1)), UnknownTrips);
+    } else {
+      C.Trips = UnknownTrips;
+    }
+    C.Frequency = R.Parent < 0 ? C.Trips : SaturatingMultiply(costs[R.Parent].Frequency, C.Trips);
+    C.SelfCost = SaturatingMultiply(C.IterLatency, C.Frequency);
+    C.TotalCost = C.SelfCost;
+  }
+  for (size_t i = loops.size(); i-- > 0;) {
+    if (loops[i].Parent >= 0) {
+      auto &parent = costs[loops[i].Parent];
+      parent.TotalCost = SaturatingAdd(parent.TotalCost, costs[i].TotalCost);
+    }
+  }
+  return costs;
+}
+
+void collectHotLoops(LoopNestReport const &Report, ArrayRef<LoopCost> Costs, StringRef Module,
+                     std::vector<HotLoop> &Out) {
+  ArrayRef<LoopRecord> loops = Report.loops();
+  for (size_t i = 0; i < loops.size(); ++i) {
+    Out.emplace_back();
+    HotLoop &H = Out.back();
+    H.Module = Module.str();
+    H.Function = Report.getFunction().getName().str();
+    raw_string_ostream OS(H.Header);
+    Report.printBlock(OS, loops[i].Header);
+    OS.flush();
+    H.Depth = loops[i].Depth;
+    H.Cost = Costs[i];
+  }
+}
+
+void rankHotLoops(std::vector<HotLoop> &Loops, size_t N) {
+  // ties by name, the ranking does not depend on the order the loops came in
+  auto hotter = [](HotLoop const &A, HotLoop const &B) {
+    if (A.Cost.SelfCost != B.Cost.SelfCost) return A.Cost.SelfCost > B.Cost.SelfCost;
+    return std::tie(A.Module, A.Function, A.Header) < std::tie(B.Module, B.Function, B.Header);
+  };
+  if (Loops.size() > N) {
+    std::nth_element(Loops.begin(), Loops.begin() + N, Loops.end(), hotter);
+    Loops.resize(N);
+  }
+  llvm::sort(Loops, hotter);
+}
+
+void printHotLoops(raw_ostream &OS, ArrayRef<HotLoop> Loops, bool Jsonl) {
+  for (size_t i = 0; i < Loops.size(); ++i) {
+    HotLoop const &H = Loops[i];
+    LoopCost const &C = H.Cost;
+    if (!Jsonl) {
+      OS << format("%4zu. %14llu cycles  ", i + 1, (unsigned long long)C.SelfCost) << H.Module << ": "
+         << H.Function << ", loop " << H.Header << " (depth " << H.Depth << ", " << C.IterLatency
+         << " cycles x " << C.Frequency << " iterations per call, " << (C.TripsKnown ? "" : "assumed ") << C.Trips
+         << " per entry)\n";
+      continue;
+    }
+    json::OStream J(OS);
+    J.object([&] {
+      J.attribute("rec", "hot_loop");
+      J.attribute("rank", int64_t(i + 1));
+      J.attribute("module", H.Module);
+      J.attribute("fn", H.Function);
+      J.attribute("header", H.Header);
+      J.attribute("depth", H.Depth);
+      J.attribute("self_cost", C.SelfCost);
+      J.attribute("total_cost", C.TotalCost);
+      J.attribute("iter_latency", C.IterLatency);
+      J.attribute("trips", C.Trips);
+      J.attribute("trips_known", C.TripsKnown);
+      J.attribute("frequency", C.Frequency);
+    });
+    OS << "\n";
+  }
+}
+
+}  // namespace llvm
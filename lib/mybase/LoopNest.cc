@@ -0,0 +1,133 @@
+#include "LoopNest.hh"
+
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace llvm {
+
+LoopNestReport::LoopNestReport(Function const &F, LoopInfo const &LI) : F(F) {
+  if (LI.empty()) return;
+  unsigned numBlocks = 0;
+  for (auto &B : F) BlockNumbers[&B] = numBlocks++;
+
+  DenseMap<Loop const *, int> indices;
+  for (Loop *L : LI.getLoopsInPreorder()) {
+    indices[L] = Loops.size();
+    Loops.emplace_back();
+    LoopRecord &R = Loops.back();
+    R.L = L;
+    R.Parent = L->getParentLoop() ? indices.lookup(L->getParentLoop()) : -1;
+    R.Depth = L->getLoopDepth();
+    R.Header = L->getHeader();
+    R.Preheader = L->getLoopPreheader();
+    SmallVector<BasicBlock *, 2> exits;
+    L->getUniqueExitBlocks(exits);
+    R.Exits.assign(exits.begin(), exits.end());
+    R.NumBlocks = L->getNumBlocks();
+    for (auto *B : L->blocks()) {
+      R.NumInsts += B->size();
+      if (LI.getLoopFor(B) == L) R.NumOwnInsts += B->size();
+    }
+  }
+}
+
+void LoopNestReport::addTripCounts(ScalarEvolution &SE) {
+  for (auto &R : Loops) {
+    const SCEV *taken = SE.getBackedgeTakenCount(R.L);
+    if (!isa<SCEVCouldNotCompute>(taken)) {
+      raw_string_ostream OS(R.BackedgeTaken);
+      taken->print(OS);
+      OS.flush();
+      if (auto *C = dyn_cast<SCEVConstant>(taken)) {
+        if (C->getAPInt().getActiveBits() <= 64) R.ConstBackedgeTaken = C->getAPInt().getZExtValue();
+      }
+    }
+    if (auto *C = dyn_cast<SCEVConstant>(SE.getConstantMaxBackedgeTakenCount(R.L))) {
+      if (C->getAPInt().getActiveBits() <= 64) R.MaxBackedgeTaken = C->getAPInt().getZExtValue();
+    }
+  }
+
+  // preorder backwards, subloops come before the loop holding them
+  std::vector<Optional<uint64_t>> inner(Loops.size(), uint64_t(0));
+  for (size_t i = Loops.size(); i-- > 0;) {
+    LoopRecord &R = Loops[i];
+    // the constant maximum of a loop bounded by a runtime value is about
+    // 2^64, only an exact count gives an estimate worth printing
+    if (R.ConstBackedgeTaken && inner[i]) {
+      uint64_t body = SaturatingAdd(R.NumOwnInsts, *inner[i]);
+      R.EstimatedInsts = SaturatingMultiply(SaturatingAdd(*R.ConstBackedgeTaken, uint64_t(1)), body);
+    }
+    if (R.Parent < 0) continue;
+    auto &sum = inner[R.Parent];
+    if (sum && R.EstimatedInsts) {
+      sum = SaturatingAdd(*sum, *R.EstimatedInsts);
+    } else {
+      sum = None;
+    }
+  }
+}
+
+void LoopNestReport::printBlock(raw_ostream &OS, BasicBlock const *B) const {
+  if (B->hasName()) {
+    OS << B->getName();
+  } else {
+    OS << "bb" << BlockNumbers.lookup(B);
+  }
+}
+
+void LoopNestReport::print(raw_ostream &OS) const {
+  for (auto &R : Loops) {
+    OS.indent(2 * R.Depth) << "loop ";
+    printBlock(OS, R.Header);
+    OS << ": depth " << R.Depth << ", " << R.NumBlocks << " blocks, " << R.NumInsts << " insts";
+    if (R.Preheader) {
+      OS << ", preheader ";
+      printBlock(OS, R.Preheader);
+    }
+    OS << ", exits";
+    if (R.Exits.empty()) OS << " none";
+    for (auto *E : R.Exits) {
+      OS << " ";
+      printBlock(OS, E);
+    }
+    OS << ", backedge-taken " << (R.BackedgeTaken.empty() ? StringRef("unknown") : StringRef(R.BackedgeTaken));
+    if (R.MaxBackedgeTaken && !R.ConstBackedgeTaken) OS << " (max " << *R.MaxBackedgeTaken << ")";
+    if (R.EstimatedInsts) OS << ", ~" << *R.EstimatedInsts << " insts per entry";
+    OS << "\n";
+  }
+}
+
+void LoopNestReport::writeJsonl(raw_ostream &OS) const {
+  for (size_t i = 0; i < Loops.size(); ++i) {
+    auto &R = Loops[i];
+    json::OStream J(OS);
+    J.object([&] {
+      J.attribute("rec", "loop");
+      J.attribute("fn", F.getName());
+      J.attribute("id", int64_t(i));
+      J.attribute("parent", R.Parent);
+      J.attribute("depth", R.Depth);
+      J.attribute("header", BlockNumbers.lookup(R.Header));
+      if (R.Header->hasName()) J.attribute("header_name", R.Header->getName());
+      if (R.Preheader) J.attribute("preheader", BlockNumbers.lookup(R.Preheader));
+      J.attributeArray("exits", [&] {
+        for (auto *E : R.Exits) J.value(BlockNumbers.lookup(E));
+      });
+      J.attribute("blocks", R.NumBlocks);
+      J.attribute("insts", R.NumInsts);
+      J.attribute("own_insts", R.NumOwnInsts);
+      if (!R.BackedgeTaken.empty()) J.attribute("backedge_taken", R.BackedgeTaken);
+      if (R.ConstBackedgeTaken) J.attribute("btc", *R.ConstBackedgeTaken);
+      if (R.MaxBackedgeTaken) J.attribute("max_btc", *R.MaxBackedgeTaken);
+      if (R.EstimatedInsts) J.attribute("est_insts", *R.EstimatedInsts);
+    });
+    OS << "\n";
+  }
+}
+
+}  // namespace llvm
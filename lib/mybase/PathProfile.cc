@@ -0,0 +1,142 @@
+#include "PathProfile.hh"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+
+namespace llvm {
+
+namespace {
+/// A + B, widened by a word whenever the sum would not fit
+APInt addGrow(APInt const &A, APInt const &B) {
+  unsigned width = std::max(A.getBitWidth(), B.getBitWidth());
+  bool overflow;
+  APInt sum = A.zext(width).uadd_ov(B.zext(width), overflow);
+  if (!overflow) return sum;
+  return A.zext(width + 64) + B.zext(width + 64);
+}
+}  // namespace
+
+PathNumbering::PathNumbering(Function &F) : NumPaths(64, 0) {
+  DenseMap<BasicBlock const *, unsigned> index;
+  for (auto &B : F) {
+    index[&B] = Blocks.size();
+    Blocks.push_back(&B);
+  }
+  unsigned n = Blocks.size(), root = n, exit = n + 1;
+  Succs.resize(n + 2);
+
+  // distinct successors, parallel edges cannot be told apart by edge code
+  std::vector<SmallVector<unsigned, 2>> succOf(n);
+  for (unsigned v = 0; v < n; ++v) {
+    SmallPtrSet<BasicBlock *, 4> seen;
+    for (auto *S : successors(Blocks[v])) {
+      if (seen.insert(S).second) succOf[v].push_back(index[S]);
+    }
+  }
+
+  // DFS from the entry: an edge into a block still on the stack is a back
+  // edge, and blocks finish in reverse topological order of the DAG
+  enum : uint8_t { Unvisited, OnStack, Done };
+  std::vector<uint8_t> state(n, Unvisited);
+  std::vector<unsigned> finished;
+  DenseSet<std::pair<unsigned, unsigned>> backEdges;
+  std::vector<std::pair<unsigned, unsigned>> dfs;
+  if (n) {
+    dfs.emplace_back(0, 0);
+    state[0] = OnStack;
+  }
+  while (!dfs.empty()) {
+    unsigned v = dfs.back().first;
+    unsigned &next = dfs.back().second;
+    if (next == succOf[v].size()) {
+      state[v] = Done;
+      finished.push_back(v);
+      dfs.pop_back();
+      continue;
+    }
+    unsigned w = succOf[v][next++];
+    if (state[w] == OnStack) {
+      backEdges.insert({v, w});
+    } else if (state[w] == Unvisited) {
+      state[w] = OnStack;
+      dfs.emplace_back(w, 0);
+    }
+  }
+
+  // a back edge v -> w becomes the dummy edges v -> exit and root -> w
+  std::vector<bool> isLoopStart(n);
+  for (unsigned v = 0; v < n; ++v) {
+    if (state[v] != Done) continue;
+    bool endsPaths = succOf[v].empty();
+    for (unsigned w : succOf[v]) {
+      if (backEdges.count({v, w})) {
+        endsPaths = isLoopStart[w] = true;
+      } else {
+        Succs[v].push_back({w, APInt()});
+      }
+    }
+    if (endsPaths) Succs[v].push_back({exit, APInt()});
+    if (succOf[v].empty()) Exits.push_back(Blocks[v]);
+  }
+  if (n) Succs[root].push_back({0, APInt()});
+  for (unsigned w = 0; w < n; ++w) {
+    if (isLoopStart[w]) Succs[root].push_back({w, APInt()});
+  }
+
+  // paths to the exit: an edge's increment is the paths of its elder siblings
+  std::vector<APInt> paths(n + 2, APInt(64, 0));
+  paths[exit] = APInt(64, 1);
+  finished.push_back(root);
+  for (unsigned v : finished) {
+    APInt sum(64, 0);
+    for (auto &E : Succs[v]) {
+      E.Inc = sum;
+      sum = addGrow(sum, paths[E.Dst]);
+    }
+    paths[v] = sum;
+  }
+  NumPaths = paths[root];
+
+  // one width for everything, so IDs and increments compare directly
+  unsigned width = NumPaths.getBitWidth();
+  for (auto &edges : Succs) {
+    for (auto &E : edges) E.Inc = E.Inc.zext(width);
+  }
+  auto incOf = [this](unsigned V, unsigned W) {
+    return find_if(Succs[V], [W](DagEdge const &E) { return E.Dst == W; })->Inc;
+  };
+
+  for (unsigned v = 0; v < n; ++v) {
+    if (state[v] != Done) continue;
+    for (unsigned w : succOf[v]) {
+      bool isBack = backEdges.count({v, w});
+      APInt inc = incOf(v, isBack ? exit : w);
+      if (!isBack && inc.isZero()) continue;
+      auto where = EdgeProfilePlan::placementOf(Blocks[v], Blocks[w]);
+      if (where == EdgeProfilePlan::Split && !EdgeProfilePlan::canSplit(Blocks[v], Blocks[w])) Valid = false;
+      Actions.push_back({Blocks[v], Blocks[w], where, isBack, inc, isBack ? incOf(root, w) : APInt(width, 0)});
+    }
+  }
+}
+
+PathNumbering::DecodedPath PathNumbering::decode(APInt Id) const {
+  DecodedPath path;
+  unsigned root = Blocks.size(), exit = Blocks.size() + 1;
+  Id = Id.zextOrTrunc(NumPaths.getBitWidth());
+  if (Id.uge(NumPaths)) return path;
+  for (unsigned v = root; v != exit;) {
+    // increments grow along the out-edges, take the last one not above Id
+    auto it = std::prev(partition_point(Succs[v], [&Id](DagEdge const &E) { return E.Inc.ule(Id); }));
+    Id -= it->Inc;
+    if (v == root) path.FromBackEdge = it != Succs[v].begin();
+    if (it->Dst == exit) path.ToBackEdge = Blocks[v]->getTerminator()->getNumSuccessors() != 0;
+    v = it->Dst;
+    if (v != exit) path.Blocks.push_back(Blocks[v]);
+  }
+  return path;
+}
+
+}  // namespace llvm
@@ -0,0 +1,389 @@
+#include "PointsTo.hh"
+
+#include "FunctionRoles.hh"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace llvm {
+
+/// the values that get a node: pointers and what can carry one by value
+static bool hasNode(Type const *T) { return T->isPtrOrPtrVectorTy() || T->isStructTy() || T->isArrayTy(); }
+
+unsigned PointsToGraph::newNode(Value const *Object) {
+  unsigned n = Nodes.size();
+  Nodes.emplace_back();
+  Rep.push_back(n);
+  ObjectOf.push_back(Object);
+  if (Object) Objects.push_back(n);
+  return n;
+}
+
+unsigned PointsToGraph::find(unsigned N) const {
+  unsigned root = N;
+  while (Rep[root] != root) root = Rep[root];
+  while (Rep[N] != root) {
+    unsigned next = Rep[N];
+    Rep[N] = root;
+    N = next;
+  }
+  return root;
+}
+
+/// the node of V, created along with the object of a global, ~0U if V
+/// cannot point anywhere
+unsigned PointsToGraph::getValueNode(Value const *V) {
+  if (!hasNode(V->getType())) return ~0U;
+  if (auto *GA = dyn_cast<GlobalAlias>(V)) return getValueNode(GA->getAliasee());
+  if (auto *CE = dyn_cast<ConstantExpr>(V)) {
+    if (CE->isCast() || CE->getOpcode() == Instruction::GetElementPtr) return getValueNode(CE->getOperand(0));
+    return ~0U;
+  }
+  if (isa<Constant>(V) && !isa<GlobalObject>(V)) return ~0U;
+
+  auto it = ValueNodes.find(V);
+  if (it != ValueNodes.end()) return it->second;
+  unsigned n = newNode();
+  ValueNodes[V] = n;
+  if (isa<GlobalObject>(V)) {
+    unsigned object = newNode(V);
+    ObjectNodes[V] = object;
+    Nodes[n].Pts.set(object);
+  }
+  return n;
+}
+
+unsigned PointsToGraph::lookupValueNode(Value const *V) const {
+  if (auto *GA = dyn_cast<GlobalAlias>(V)) return lookupValueNode(GA->getAliasee());
+  if (auto *CE = dyn_cast<ConstantExpr>(V)) {
+    if (CE->isCast() || CE->getOpcode() == Instruction::GetElementPtr) return lookupValueNode(CE->getOperand(0));
+    return ~0U;
+  }
+  auto it = ValueNodes.find(V);
+  return it == ValueNodes.end() ? ~0U : it->second;
+}
+
+/// Object holds the pointers found in its initializer C
+void PointsToGraph::addInitializer(unsigned Object, Constant const *C) {
+  if (isa<ConstantAggregate>(C)) {
+    for (auto &op : C->operands()) addInitializer(Object, cast<Constant>(op.get()));
+    return;
+  }
+  unsigned n = getValueNode(C);
+  if (n != ~0U) addEdge(n, Object);
+}
+
+void PointsToGraph::connectCall(CallBase const *CB, Function const *F) {
+  if (F->isDeclaration()) return;
+  unsigned numArgs = std::min<unsigned>(CB->arg_size(), F->arg_size());
+  for (unsigned i = 0; i < numArgs; ++i) {
+    unsigned arg = lookupValueNode(CB->getArgOperand(i)), param = lookupValueNode(F->getArg(i));
+    if (arg != ~0U && param != ~0U) addEdge(arg, param);
+  }
+  unsigned ret = ReturnNodes.lookup(F), result = lookupValueNode(CB);
+  if (ret && result != ~0U) addEdge(ret, result);
+}
+
+void PointsToGraph::push(unsigned N) {
+  if (Queued[N]) return;
+  Queued[N] = true;
+  Worklist.push_back(N);
+}
+
+/// a copy edge From -> To, To gets what From has propagated so far, the
+/// rest follows once From is visited
+void PointsToGraph::addEdge(unsigned From, unsigned To) {
+  From = find(From);
+  To = find(To);
+  if (From == To || !Nodes[From].Copy.test_and_set(To)) return;
+  if (Queued.empty()) {
+    // still generating constraints, the first visit propagates it all
+    return;
+  }
+  if (Nodes[To].Pts |= Nodes[From].Prev) push(To);
+}
+
+PointsToGraph::PointsToGraph(Module &M) {
+  // constraints: a node includes an object (Pts), another node (Copy), the
+  // contents of what a node points to (Loads) or the other way (Stores)
+  for (auto &G : M.globals()) {
+    getValueNode(&G);
+    if (G.hasDefinitiveInitializer()) addInitializer(ObjectNodes.lookup(&G), G.getInitializer());
+  }
+  for (auto &F : M) {
+    getValueNode(&F);
+    if (F.isDeclaration()) continue;
+    if (hasNode(F.getReturnType())) ReturnNodes[&F] = newNode();
+    for (auto &A : F.args()) getValueNode(&A);
+  }
+
+  SmallVector<CallBase const *, 16> directCalls;
+  for (auto &F : M) {
+    for (auto &I : instructions(F)) {
+      unsigned n = getValueNode(&I);
+      auto copy = [&](Value const *From) {
+        unsigned from = getValueNode(From);
+        if (from != ~0U && n != ~0U) addEdge(from, n);
+      };
+      switch (I.getOpcode()) {
+        case Instruction::Alloca: {
+          unsigned object = newNode(&I);
+          ObjectNodes[&I] = object;
+          Nodes[n].Pts.set(object);
+          break;
+        }
+        case Instruction::GetElementPtr:
+        case Instruction::BitCast:
+        case Instruction::AddrSpaceCast:
+        case Instruction::ExtractValue:
+        case Instruction::Freeze: copy(I.getOperand(0)); break;
+        case Instruction::InsertValue:
+          copy(I.getOperand(0));
+          copy(I.getOperand(1));
+          break;
+        case Instruction::Select:
+          copy(I.getOperand(1));
+          copy(I.getOperand(2));
+          break;
+        case Instruction::PHI:
+          for (auto &op : cast<PHINode>(I).incoming_values()) copy(op.get());
+          break;
+        case Instruction::Load: {
+          unsigned ptr = getValueNode(cast<LoadInst>(I).getPointerOperand());
+          if (ptr != ~0U && n != ~0U) Nodes[ptr].Loads.push_back(n);
+          break;
+        }
+        case Instruction::Store: {
+          auto &S = cast<StoreInst>(I);
+          unsigned ptr = getValueNode(S.getPointerOperand()), value = getValueNode(S.getValueOperand());
+          if (ptr != ~0U && value != ~0U) Nodes[ptr].Stores.push_back(value);
+          break;
+        }
+        case Instruction::Ret: {
+          auto *value = cast<ReturnInst>(I).getReturnValue();
+          unsigned from = value ? getValueNode(value) : ~0U;
+          if (from != ~0U) addEdge(from, ReturnNodes.lookup(&F));
+          break;
+        }
+        case Instruction::Call:
+        case Instruction::Invoke:
+        case Instruction::CallBr: {
+          auto &CB = cast<CallBase>(I);
+          for (auto &arg : CB.args()) getValueNode(arg.get());
+          auto *callee = dyn_cast<Function>(CB.getCalledOperand()->stripPointerCasts());
+          if (!callee) {
+            unsigned target = getValueNode(CB.getCalledOperand());
+            if (target != ~0U) Nodes[target].Calls.push_back(&CB);
+            break;
+          }
+          unsigned roles = FunctionRoleIndex::classify(*callee);
+          if (roles & k_roleAllocator && n != ~0U) {
+            unsigned object = newNode(&I);
+            ObjectNodes[&I] = object;
+            Nodes[n].Pts.set(object);
+          } else if (roles & k_roleMemIntrinsic && callee->getIntrinsicID() != Intrinsic::memset) {
+            // *dst includes *src, through a node of its own
+            unsigned dst = getValueNode(CB.getArgOperand(0)), src = getValueNode(CB.getArgOperand(1));
+            if (dst == ~0U || src == ~0U) break;
+            unsigned tmp = newNode();
+            Nodes[src].Loads.push_back(tmp);
+            Nodes[dst].Stores.push_back(tmp);
+          } else {
+            directCalls.push_back(&CB);
+          }
+          break;
+        }
+        default: break;
+      }
+    }
+  }
+  for (auto *CB : directCalls) connectCall(CB, cast<Function>(CB->getCalledOperand()->stripPointerCasts()));
+
+  solve();
+  Queued = {};
+  CheckedEdges.clear();
+  for (auto &N : Nodes) {
+    N.Prev.clear();
+    N.Copy.clear();
+    N.Loads = {};
+    N.Stores = {};
+    N.Calls = {};
+  }
+}
+
+void PointsToGraph::solve() {
+  Queued.assign(Nodes.size(), false);
+  for (unsigned n = 0, e = Nodes.size(); n < e; ++n) {
+    if (!Nodes[n].Pts.empty()) push(n);
+  }
+
+  // rounds over what the previous round queued, the edges found to join
+  // equal sets during a round are searched for cycles at its end, in one go
+  std::vector<unsigned> cycleRoots;
+  while (!Worklist.empty()) {
+    for (size_t round = Worklist.size(); round; --round) {
+      unsigned n = Worklist.front();
+      Worklist.pop_front();
+      Queued[n] = false;
+      if (find(n) != n) continue;
+      Node &N = Nodes[n];
+      PointsToSet diff;
+      diff.intersectWithComplement(N.Pts, N.Prev);
+      if (diff.empty()) continue;
+      N.Prev = N.Pts;
+
+      for (unsigned o : diff) {
+        unsigned object = find(o);
+        for (unsigned dst : N.Loads) addEdge(object, dst);
+        for (unsigned src : N.Stores) addEdge(src, object);
+        if (auto *F = dyn_cast<Function>(ObjectOf[o])) {
+          for (auto *CB : N.Calls) connectCall(CB, F);
+        }
+      }
+
+      // N.Copy may point to merged nodes, their representative takes it
+      for (unsigned m : N.Copy) {
+        m = find(m);
+        if (m == n) continue;
+        if (Nodes[m].Pts |= diff) push(m);
+        if (Nodes[m].Pts == N.Pts && CheckedEdges.insert({n, m}).second) cycleRoots.push_back(m);
+      }
+    }
+    if (!cycleRoots.empty()) collapseCycles(cycleRoots);
+    cycleRoots.clear();
+  }
+}
+
+/// Tarjan over the copy edges reachable from Roots, every SCC found is
+/// collapsed into one node
+void PointsToGraph::collapseCycles(ArrayRef<unsigned> Roots) {
+  std::vector<unsigned> index(Nodes.size(), ~0U), low, stack;
+  std::vector<bool> onStack;
+  std::vector<std::pair<unsigned, PointsToSet::iterator>> dfs;
+  std::vector<std::vector<unsigned>> sccs;
+
+  auto visit = [&](unsigned n) {
+    unsigned i = low.size();
+    index[n] = i;
+    low.push_back(i);
+    onStack.push_back(true);
+    stack.push_back(n);
+    dfs.emplace_back(n, Nodes[n].Copy.begin());
+  };
+  for (unsigned root : Roots) {
+    root = find(root);
+    if (index[root] != ~0U) continue;
+    visit(root);
+    while (!dfs.empty()) {
+      unsigned n = dfs.back().first, i = index[n];
+      auto &it = dfs.back().second;
+      if (it != Nodes[n].Copy.end()) {
+        unsigned m = find(*it);
+        ++it;
+        if (index[m] == ~0U) {
+          visit(m);
+        } else if (onStack[index[m]]) {
+          low[i] = std::min(low[i], index[m]);
+        }
+        continue;
+      }
+      dfs.pop_back();
+      if (!dfs.empty()) {
+        unsigned parent = index[dfs.back().first];
+        low[parent] = std::min(low[parent], low[i]);
+      }
+      if (low[i] != i) continue;
+      std::vector<unsigned> scc;
+      unsigned m;
+      do {
+        m = stack.back();
+        stack.pop_back();
+        onStack[index[m]] = false;
+        scc.push_back(m);
+      } while (m != n);
+      if (scc.size() > 1) sccs.push_back(std::move(scc));
+    }
+  }
+
+  for (auto &scc : sccs) {
+    for (unsigned k = 1; k < scc.size(); ++k) merge(scc[0], scc[k]);
+    push(scc[0]);
+  }
+}
+
+/// N joins Into, what has been propagated is what both have propagated
+void PointsToGraph::merge(unsigned Into, unsigned N) {
+  Node &A = Nodes[Into], &B = Nodes[N];
+  Rep[N] = Into;
+  ++NumCollapsed;
+  A.Pts |= B.Pts;
+  A.Prev &= B.Prev;
+  A.Copy |= B.Copy;
+  A.Copy.reset(Into);
+  A.Copy.reset(N);
+  A.Loads.append(B.Loads.begin(), B.Loads.end());
+  A.Stores.append(B.Stores.begin(), B.Stores.end());
+  A.Calls.append(B.Calls.begin(), B.Calls.end());
+  B = Node();
+}
+
+unsigned PointsToGraph::getObjectNumber(Value const *V) const {
+  auto it = ObjectNodes.find(V);
+  return it == ObjectNodes.end() ? ~0U : it->second;
+}
+
+PointsToGraph::PointsToSet const &PointsToGraph::getPointsTo(Value const *V) const {
+  static PointsToSet const empty;
+  unsigned n = lookupValueNode(V);
+  return n == ~0U ? empty : Nodes[find(n)].Pts;
+}
+
+void PointsToGraph::getPointees(Value const *V, SmallVectorImpl<Value const *> &Out) const {
+  for (unsigned o : getPointsTo(V)) Out.push_back(ObjectOf[o]);
+}
+
+void PointsToGraph::print(raw_ostream &OS, Module const &M) const {
+  auto printSet = [&](Value const *V) {
+    auto &pts = getPointsTo(V);
+    if (pts.empty()) return;
+    OS << "  ";
+    V->printAsOperand(OS, false);
+    OS << " ->";
+    for (unsigned o : pts) {
+      OS << ' ';
+      ObjectOf[o]->printAsOperand(OS, false);
+    }
+    OS << '\n';
+  };
+  OS << "points-to: " << Objects.size() << " objects, " << Nodes.size() << " nodes, " << NumCollapsed
+     << " collapsed\n";
+  for (auto &G : M.globals()) printSet(&G);
+  for (auto &F : M) {
+    if (F.isDeclaration()) continue;
+    OS << F.getName() << ":\n";
+    for (auto &A : F.args()) printSet(&A);
+    for (auto &I : instructions(F)) printSet(&I);
+  }
+}
+
+AnalysisKey PointsToAnalysis::Key;
+
+bool PointsToWrapperPass::runOnModule(Module &M) {
+  Graph = std::make_unique<PointsToGraph>(M);
+  return false;
+}
+
+void PointsToWrapperPass::print(raw_ostream &OS, Module const *M) const {
+  if (Graph && M) Graph->print(OS, *M);
+}
+
+char PointsToWrapperPass::ID = 0;
+static RegisterPass<PointsToWrapperPass> X("points-to", "Andersen points-to sets", false, true);
+
+}  // namespace llvm
@@ -0,0 +1,95 @@
+#include "Reachability.hh"
+
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Function.h"
+
+namespace llvm {
+
+ReachabilityIndex::ReachabilityIndex(Function &F) {
+  for (auto &B : F) {
+    Numbers[&B] = Blocks.size();
+    Blocks.push_back(&B);
+  }
+
+  // iterative Tarjan over every block, unreachable ones too, so an SCC gets
+  // its id after all the SCCs it reaches
+  unsigned n = Blocks.size();
+  std::vector<unsigned> low(n), order(n, ~0U);
+  std::vector<bool> onStack(n);
+  std::vector<unsigned> stack;
+  std::vector<std::pair<unsigned, succ_iterator>> dfs;
+  SCCOf.assign(n, ~0U);
+  unsigned nextOrder = 0;
+  auto visit = [&](unsigned v) {
+    order[v] = low[v] = nextOrder++;
+    stack.push_back(v);
+    onStack[v] = true;
+    dfs.emplace_back(v, succ_begin(Blocks[v]));
+  };
+  for (unsigned root = 0; root < n; ++root) {
+    if (order[root] != ~0U) continue;
+    visit(root);
+    while (!dfs.empty()) {
+      unsigned v = dfs.back().first;
+      succ_iterator &it = dfs.back().second;
+      if (it != succ_end(Blocks[v])) {
+        unsigned w = Numbers[*it++];
+        if (order[w] == ~0U) {
+          visit(w);
+        } else if (onStack[w]) {
+          low[v] = std::min(low[v], order[w]);
+        }
+        continue;
+      }
+      dfs.pop_back();
+      if (!dfs.empty()) low[dfs.back().first] = std::min(low[dfs.back().first], low[v]);
+      if (low[v] != order[v]) continue;
+      unsigned w, scc = SCCSize.size();
+      SCCSize.push_back(0);
+      do {
+        w = stack.back();
+        stack.pop_back();
+        onStack[w] = false;
+        SCCOf[w] = scc;
+        ++SCCSize[scc];
+      } while (w != v);
+    }
+  }
+
+  // successors' closures are complete by the time an SCC is reached
+  unsigned numSCCs = SCCSize.size();
+  std::vector<std::vector<unsigned>> members(numSCCs);
+  for (unsigned i = 0; i < n; ++i) members[SCCOf[i]].push_back(i);
+  Closure.assign(numSCCs, BitVector(numSCCs));
+  for (unsigned c = 0; c < numSCCs; ++c) {
+    Closure[c].set(c);
+    for (unsigned i : members[c]) {
+      for (auto *S : successors(Blocks[i])) {
+        unsigned s = SCCOf[Numbers[S]];
+        if (!Closure[c].test(s)) Closure[c] |= Closure[s];
+      }
+    }
+  }
+}
+
+bool ReachabilityIndex::invalidate(Function &F, PreservedAnalyses const &PA,
+                                   FunctionAnalysisManager::Invalidator &Inv) {
+  auto PAC = PA.getChecker<ReachabilityAnalysis>();
+  return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>() || PAC.preservedSet<CFGAnalyses>());
+}
+
+AnalysisKey ReachabilityAnalysis::Key;
+
+ReachabilityIndex ReachabilityAnalysis::run(Function &F, FunctionAnalysisManager &FAM) {
+  return ReachabilityIndex(F);
+}
+
+bool ReachabilityWrapperPass::runOnFunction(Function &F) {
+  Index = std::make_unique<ReachabilityIndex>(F);
+  return false;
+}
+
+char ReachabilityWrapperPass::ID = 0;
+static RegisterPass<ReachabilityWrapperPass> X("reachability", "Block reachability index", true, true);
+
+}  // namespace llvm
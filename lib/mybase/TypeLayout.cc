@@ -0,0 +1,116 @@
+#include "TypeLayout.hh"
+
+#include "llvm/ADT/DenseMapInfo.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/TypeFinder.h"
+
+namespace llvm {
+
+/// slots of an empty cache, a module rarely has fewer distinct types
+static unsigned const k_initialSlots = 64;
+
+TypeLayoutCache::TypeLayoutCache(DataLayout const &DL) : DL(DL), Slots(k_initialSlots) {}
+
+TypeLayoutCache::Slot &TypeLayoutCache::find(Type const *T) {
+  unsigned mask = Slots.size() - 1;
+  unsigned i = DenseMapInfo<Type const *>::getHashValue(T) & mask;
+  while (Slots[i].Key && Slots[i].Key != T) i = (i + 1) & mask;
+  return Slots[i];
+}
+
+void TypeLayoutCache::grow() {
+  std::vector<Slot> old(Slots.size() * 2);
+  old.swap(Slots);
+  for (auto &S : old) {
+    if (S.Key) find(S.Key) = S;
+  }
+}
+
+TypeLayout const &TypeLayoutCache::get(Type const *T) {
+  Slot &S = find(T);
+  if (S.Key) return Layouts[S.Layout];
+
+  auto *Ty = const_cast<Type *>(T);
+  TypeLayout L;
+  L.Sized = Ty->isSized();
+  if (L.Sized) {
+    TypeSize bits = DL.getTypeSizeInBits(Ty);
+    L.Scalable = bits.isScalable();
+    L.SizeInBits = bits.getKnownMinSize();
+    L.StoreSize = DL.getTypeStoreSize(Ty).getKnownMinSize();
+    L.AllocSize = DL.getTypeAllocSize(Ty).getKnownMinSize();
+    L.Align = DL.getABITypeAlign(Ty).value();
+    if (auto *ST = dyn_cast<StructType>(Ty)) {
+      StructLayout const *SL = DL.getStructLayout(ST);
+      L.FieldBegin = FieldOffsets.size();
+      L.NumFields = ST->getNumElements();
+      for (unsigned i = 0; i < L.NumFields; ++i) FieldOffsets.push_back(SL->getElementOffset(i));
+    }
+  }
+
+  S.Key = T;
+  S.Layout = Layouts.size();
+  Layouts.push_back(L);
+  if (Layouts.size() * 4 > Slots.size() * 3) grow();
+  return Layouts.back();
+}
+
+uint64_t TypeLayoutCache::getTypeSize(Type const *T) {
+  if (T->isFunctionTy())  // not sized
+    return DL.getPointerSize();
+  auto &L = get(T);
+  return L.Sized ? L.AllocSize : 0;
+}
+
+Optional<int64_t> TypeLayoutCache::getGEPOffset(GEPOperator const &GEP) {
+  int64_t offset = 0;
+  for (auto GTI = gep_type_begin(GEP), GTE = gep_type_end(GEP); GTI != GTE; ++GTI) {
+    auto *CI = dyn_cast<ConstantInt>(GTI.getOperand());
+    if (!CI) return None;
+    if (StructType *ST = GTI.getStructTypeOrNull()) {
+      offset += getFieldOffsets(ST)[CI->getZExtValue()];
+      continue;
+    }
+    if (CI->isZero()) continue;
+    auto &L = get(GTI.getIndexedType());
+    if (!L.Sized || L.Scalable) return None;
+    offset += CI->getSExtValue() * int64_t(L.AllocSize);
+  }
+  return offset;
+}
+
+void TypeLayoutCache::getGEPOffsets(ArrayRef<GEPOperator const *> GEPs, MutableArrayRef<Optional<int64_t>> Offsets) {
+  assert(GEPs.size() == Offsets.size() && "one offset per GEP");
+  for (size_t i = 0; i < GEPs.size(); ++i) Offsets[i] = getGEPOffset(*GEPs[i]);
+}
+
+void layoutStructTypes(Module const &M) {
+  TypeFinder structs;
+  structs.run(M, false);
+  DataLayout const &DL = M.getDataLayout();
+  // the layout of a struct lays out the structs it holds as well
+  for (StructType *ST : structs) {
+    if (ST->isSized()) DL.getStructLayout(ST);
+  }
+}
+
+AnalysisKey TypeLayoutAnalysis::Key;
+
+TypeLayoutCache TypeLayoutAnalysis::run(Module &M, ModuleAnalysisManager &MAM) {
+  return TypeLayoutCache(M.getDataLayout());
+}
+
+bool TypeLayoutWrapperPass::runOnModule(Module &M) {
+  Cache = std::make_unique<TypeLayoutCache>(M.getDataLayout());
+  return false;
+}
+
+char TypeLayoutWrapperPass::ID = 0;
+static RegisterPass<TypeLayoutWrapperPass> X("type-layout", "DataLayout type layout cache", false, true);
+
+}  // namespace llvm
@@ -0,0 +1,99 @@
+#include "TypeProperties.hh"
+
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/ErrorHandling.h"
+
+#include "LLDump.hh"
+#include "LLUtils.hh"
+
+namespace llvm {
+
+TypeProps const &TypePropertyCache::get(Type const *T) {
+  auto it = Props.find(T);
+  if (it != Props.end()) return it->second;
+  // the defaults stand for T while its elements are visited
+  Props[T];
+
+  TypeProps P;
+  if (auto *PT = dyn_cast<PointerType>(T)) {
+    P.ContainsPointer = true;
+    P.PointerDepth = 1;
+    if (!PT->isOpaque()) {  // an opaque pointee says nothing
+      Type const *pointee = PT->getNonOpaquePointerElementType();
+      P.IntegerRelated = isa<IntegerType>(pointee);  // int*
+      // what does not depend on the pointee is right for a struct pointing
+      // to itself already
+      Props[T] = P;
+      P.PointerDepth += get(pointee).PointerDepth;
+    }
+  } else if (auto *ST = dyn_cast<StructType>(T)) {  // struct with int/int* or recursively
+    P.IntegerRelated = true;
+    for (Type const *eleTy : ST->elements()) {
+      auto const &E = get(eleTy);
+      P.IntegerRelated &= E.IntegerRelated;
+      P.ContainsPointer |= E.ContainsPointer;
+    }
+  } else if (isa<ArrayType>(T)) {  // array with int/int* or recursively
+    auto const &E = get(T->getArrayElementType());
+    P.IntegerRelated = E.IntegerRelated;
+    P.ContainsPointer = E.ContainsPointer;
+  } else if (isa<VectorType>(T)) {
+    P.ContainsPointer = get(cast<VectorType>(T)->getElementType()).ContainsPointer;
+  } else {
+    P.IntegerRelated = isa<IntegerType>(T);  // int
+  }
+  // the visits above may have grown the map
+  return Props[T] = P;
+}
+
+bool TypePropertyCache::isPointerValue(Value const *V) {
+  unsigned depth = get(V->getType()).PointerDepth;
+  // utils::isTrivialPointer, the value itself is the address of the object
+  if (isa<AllocaInst>(V) || isa<GlobalVariable>(V) || isa<Function>(V)) return depth >= 2;
+  return depth >= 1;
+}
+
+/// utils::isPointerManipulation, case by case
+bool TypePropertyCache::isPointerManipulation(Instruction const *I) {
+  if (isa<AllocaInst>(I)) {
+    return false;
+  } else if (isa<LoadInst>(I)) {  /// PointerOperand's element type
+    if (get(I->getOperand(0)->getType()).PointerDepth >= 2) return true;
+  } else if (isa<StoreInst>(I)) {  /// ValueOperand type
+    if (I->getOperand(0)->getType()->isPointerTy()) return true;
+  } else if (isa<BitCastInst>(I)) {
+    if (I->getType()->isPointerTy() && I->getOperand(0)->getType()->isPointerTy()) return true;
+  } else if (isa<GetElementPtrInst>(I)) {
+    return true;
+  } else if (auto const *C = dyn_cast<CallInst>(I)) {
+    if (C->isInlineAsm()) return false;
+    return utils::isFn_mem_ops(C->getCalledFunction());
+  } else if (isa<PHINode>(I) || isa<ExtractValueInst>(I)) {
+    return isPointerValue(I);
+  } else if (auto const *IV = dyn_cast<InsertValueInst>(I)) {
+    return isPointerValue(IV->getInsertedValueOperand());
+  } else if (isa<IntToPtrInst>(I)) {
+    return true;
+  } else if (isa<SelectInst>(I)) {
+    if (isPointerValue(I)) return true;
+  }
+
+  if (isPointerValue(I)) {
+    WITH_COLOR(raw_ostream::RED, errs() << *I << "\n");
+    report_fatal_error("Instruction can't be a Pointer Value");
+  }
+  return false;
+}
+
+void TypePropertyCache::getPointerManipulations(Function const &F, SmallVectorImpl<Instruction const *> &Out) {
+  for (auto &B : F) {
+    for (auto &I : B) {
+      if (isPointerManipulation(&I)) Out.push_back(&I);
+    }
+  }
+}
+
+}  // namespace llvm
@@ -1,37 +1,172 @@
-#define DEBUG_TYPE "count-bb"
-
 #include "llvm/Pass.h"
 
+#include "llvm/ADT/MapVector.h"
+#include "llvm/ADT/SetVector.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/Analysis/LoopInfo.h"
+
 #include "llvm/IR/Attributes.h"
 #include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
-#include "llvm/IR/TypeBuilder.h"
 
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include "llvm/Transforms/Utils/PromoteMemToReg.h"
+#include "llvm/Transforms/Utils/SSAUpdater.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 
+#include "BBProfile.hh"
+#include "EdgeProfile.hh"
 #include "LLUtils.hh"
+#include "PathProfile.hh"
 #include "LLDump.hh"
 
+#define DEBUG_TYPE "count-bb"
+
 using namespace llvm;
 
 namespace {
+enum class CounterMode { Total, Block, Edge };
+
+static cl::opt<CounterMode> CountMode(
+    "count-bb-mode", cl::desc("Counter layout inserted by count-bb"),
+    cl::init(CounterMode::Block),
+    cl::values(clEnumValN(CounterMode::Total, "total",
+                          "one counter shared by every block"),
+               clEnumValN(CounterMode::Block, "block",
+                          "one counter slot per block, dumped per function"),
+               clEnumValN(CounterMode::Edge, "edge",
+                          "counters only on the edges off a maximum spanning "
+                          "tree, counts are rebuilt by bbprof.out")));
+
+enum class CounterStrategy { Plain, Atomic, Shard, Sample };
+
+static cl::opt<CounterStrategy> CountStrategy(
+    "count-bb-strategy", cl::desc("How count-bb updates its counters"),
+    cl::init(CounterStrategy::Plain),
+    cl::values(clEnumValN(CounterStrategy::Plain, "plain",
+                          "non-atomic load/add/store, single-threaded programs only"),
+               clEnumValN(CounterStrategy::Atomic, "atomic",
+                          "relaxed atomic increments on the shared counters"),
+               clEnumValN(CounterStrategy::Shard, "shard",
+                          "relaxed atomic increments on a per-thread counter "
+                          "shard, shards are merged at exit"),
+               clEnumValN(CounterStrategy::Sample, "sample",
+                          "function entries and loop headers tick a "
+                          "per-thread countdown, when it runs out the code up "
+                          "to the next tick runs in a counting copy of the "
+                          "function, weighted by the ticks it took")));
+
+static cl::opt<unsigned> NumShards(
+    "count-bb-shards", cl::desc("Number of counter shards for -count-bb-strategy=shard"),
+    cl::init(64));
+
+static cl::opt<unsigned> SamplePeriod(
+    "count-bb-sample-period",
+    cl::desc("Default period of -count-bb-strategy=sample, the instrumented "
+             "program reads $COUNT_BB_SAMPLE_PERIOD to override it"),
+    cl::init(1000));
+
+static cl::opt<bool> PromoteLoops(
+    "count-bb-promote",
+    cl::desc("Keep the counts of blocks inside call-free loops in registers "
+             "and add them to the counters once per loop exit"),
+    cl::init(false));
+
+static cl::opt<bool> PathProfile(
+    "count-bb-paths",
+    cl::desc("Also count the Ball-Larus paths of every function, dumped as "
+             "\"<function> path <id> <count>\" and decoded by cfg-path"),
+    cl::init(false));
+
+static cl::opt<unsigned> MaxPaths(
+    "count-bb-max-paths",
+    cl::desc("Functions with more acyclic paths get no path counters"),
+    cl::init(4096));
+
+enum class OutputFormat { Text, Binary };
+
+static cl::opt<OutputFormat> Output(
+    "count-bb-output", cl::desc("What the instrumented program writes at exit"),
+    cl::init(OutputFormat::Text),
+    cl::values(clEnumValN(OutputFormat::Text, "text",
+                          "\"<function> <slot> <count>\" lines on stdout"),
+               clEnumValN(OutputFormat::Binary, "binary",
+                          "a BBProfile.hh file at $COUNT_BB_PROFILE "
+                          "(default bb.prof), merged by bbmerge.out")));
+
 static char const *k_atexitCallStr = "setupAtExit";
-static char const *bbCounterStr = "bbCounter";
+static char const *bbProfileStr = "bbProfile";
+static char const *k_defaultProfileStr = "bb.prof";
+static char const *k_shardInitStr = "bbShardInit";
+static char const *k_sampleHitStr = "bbSampleHit";
+static char const *k_sampleInitStr = "bbSampleInit";
+/// counter slots per 64-byte cache line, shards are padded to whole lines
+static unsigned const k_slotsPerLine = 8;
 
-void create_atexitCall(Function &F, GlobalVariable *BBCounter) {
-  auto *M = F.getParent();
-  LLVMContext &ctx = M->getContext();
-  auto *entryBB = BasicBlock::Create(ctx, "entry", &F);
-  FunctionType *funcTy = TypeBuilder<int(char *, ...), false>::get(ctx);
-  auto *printfFn = cast<Function>(M->getOrInsertFunction("printf", funcTy));
-  auto bbValue = new LoadInst(BBCounter, "bbValue", entryBB);
-  Constant *fmt = utils::geti8StrVal(*M, "%d BB(s) Executed\n", "fmt");
-  ArrayRef<Value *> printfArgs{fmt, bbValue};
-  CallInst::Create(printfFn, printfArgs, "", entryBB);
-  ReturnInst::Create(ctx, entryBB);
+/// emits `for (i = Begin; i != End; ++i) Body(i)` at the insert point of IRB,
+/// the builder is left at the loop exit
+void emitCountedLoop(IRBuilder<> &IRB, Value *Begin, Value *End,
+                     function_ref<void(IRBuilder<> &, Value *)> Body) {
+  Function *F = IRB.GetInsertBlock()->getParent();
+  LLVMContext &ctx = F->getContext();
+  auto *preBB = IRB.GetInsertBlock();
+  auto *headerBB = BasicBlock::Create(ctx, "loop.header", F);
+  auto *bodyBB = BasicBlock::Create(ctx, "loop.body", F);
+  auto *exitBB = BasicBlock::Create(ctx, "loop.exit", F);
+  IRB.CreateBr(headerBB);
+
+  IRB.SetInsertPoint(headerBB);
+  auto *idx = IRB.CreatePHI(Begin->getType(), 2, "i");
+  idx->addIncoming(Begin, preBB);
+  IRB.CreateCondBr(IRB.CreateICmpNE(idx, End), bodyBB, exitBB);
+
+  IRB.SetInsertPoint(bodyBB);
+  Body(IRB, idx);
+  // Body may have created blocks of its own, the latch is wherever it ended
+  auto *next = IRB.CreateAdd(idx, ConstantInt::get(idx->getType(), 1), "i.next");
+  idx->addIncoming(next, IRB.GetInsertBlock());
+  IRB.CreateBr(headerBB);
+
+  IRB.SetInsertPoint(exitBB);
+}
+
+/// a counter update that is still to be emitted, right before InsertPt; the
+/// counter is Slot + Offset for path counters, Offset is then computed at
+/// run time
+struct CounterSite {
+  Instruction *InsertPt;
+  uint64_t Slot;
+  Value *Offset = nullptr;
+};
+
+/// blocks made by splitting the edge (Src, Dst) of the original CFG, shared
+/// by the edge and path counters of a function
+using EdgeSplits = DenseMap<std::pair<BasicBlock *, BasicBlock *>, BasicBlock *>;
+
+/// counts held in registers are lost when the loop is left other than
+/// through an exit block (exit(), longjmp, unwinding), so loops with calls
+/// keep their updates in memory
+bool isPromotable(Loop const *L) {
+  for (auto *B : L->blocks()) {
+    for (auto &I : *B) {
+      auto *CB = dyn_cast<CallBase>(&I);
+      if (CB && !isa<IntrinsicInst>(CB)) return false;
+    }
+  }
+  SmallVector<BasicBlock *, 4> exits;
+  L->getUniqueExitBlocks(exits);
+  return all_of(exits, [](BasicBlock *E) { return E->getFirstInsertionPt() != E->end(); });
 }
 
 struct CountBBPass : public ModulePass {
@@ -41,9 +176,59 @@ struct CountBBPass : public ModulePass {
 
   bool runOnModule(Module &M) override;
 
-  bool runOnBasicBlock(BasicBlock &BB, Module &M);
+  bool runOnBasicBlock(BasicBlock &BB, uint64_t Slot, SmallVectorImpl<CounterSite> &Sites);
+
+  bool runOnEdges(EdgeProfilePlan const &Plan, uint64_t Base, BasicBlock *EntryTail, EdgeSplits &Splits,
+                  SmallVectorImpl<CounterSite> &Sites);
+
+  AllocaInst *runOnPaths(PathNumbering const &Plan, uint64_t Base, BasicBlock *EntryTail, EdgeSplits &Splits,
+                         SmallVectorImpl<CounterSite> &Sites);
+
+  void emitCounters(Function &F, ArrayRef<CounterSite> Sites, Value *ShardBase);
 
   bool setup(Module &M);
+
+ private:
+  void create_atexitCall(Function &F);
+  void create_shardInit(Function &F);
+  void create_sampleHit(Function &F);
+  void create_sampleInit(Function &F);
+  void emitSamples(Function &F, ArrayRef<CounterSite> Sites);
+  Value *emitShardPrologue(Function &F, BasicBlock *&EntryTail);
+  void emitShardMerge(IRBuilder<> &IRB);
+  void emitProfileWrite(IRBuilder<> &IRB);
+  Value *slotAddr(IRBuilder<> &IRB, Value *ShardBase, uint64_t Slot, Value *Offset);
+  void emitAdd(IRBuilder<> &IRB, Value *ShardBase, uint64_t Slot, Value *Offset, Value *Delta);
+
+  /// instrumented functions, their counters are the dense slice
+  /// [FnBase[i], FnBase[i + 1]) of the module-wide counter array
+  std::vector<Function *> Fns;
+  std::vector<uint64_t> FnBase;
+  /// counter placement per function in edge mode
+  std::vector<std::unique_ptr<EdgeProfilePlan>> Plans;
+  /// -count-bb-paths: the path counters of function i are the slice
+  /// [PathBase[i], PathBase[i + 1]) behind all the block or edge counters
+  std::vector<std::unique_ptr<PathNumbering>> PathPlans;
+  std::vector<uint64_t> PathBase;
+  /// slots in use and the distance between two shards (strategy=shard)
+  uint64_t NumSlots = 0;
+  uint64_t ShardStride = 0;
+  ArrayType *CountersTy = nullptr;
+  /// the counters live at the tail of the in-memory image of the binary
+  /// profile, so writing it out is one fwrite of the image's prefix
+  GlobalVariable *Profile = nullptr;
+  Constant *Counters = nullptr;
+  uint64_t ProfileSize = 0;
+  /// thread-local pointer to the shard of the current thread
+  GlobalVariable *ShardTLS = nullptr;
+  Function *ShardInit = nullptr;
+  /// strategy=sample: the mean period, and per thread the countdown to the
+  /// next sampled stretch, the length it was armed with and the xorshift state
+  GlobalVariable *Period = nullptr;
+  GlobalVariable *Countdown = nullptr;
+  GlobalVariable *Armed = nullptr;
+  GlobalVariable *Rng = nullptr;
+  Function *SampleHit = nullptr;
 };
 }  // namespace
 
@@ -53,6 +238,424 @@ static RegisterPass<CountBBPass> X("count-bb",
                                    "Counts no. of executed BasicBlocks", false,
                                    false);
 
+void CountBBPass::create_atexitCall(Function &F) {
+  auto *M = F.getParent();
+  LLVMContext &ctx = M->getContext();
+  Type *i64Ty = Type::getInt64Ty(ctx);
+  auto *entryBB = BasicBlock::Create(ctx, "entry", &F);
+  IRBuilder<> IRB(entryBB);
+  FunctionType *funcTy = FunctionType::get(IRB.getInt32Ty(), {IRB.getInt8PtrTy()}, true);
+  FunctionCallee printfFn = M->getOrInsertFunction("printf", funcTy);
+
+  if (CountStrategy == CounterStrategy::Shard) {
+    emitShardMerge(IRB);
+  }
+
+  if (Output == OutputFormat::Binary) {
+    emitProfileWrite(IRB);
+    IRB.CreateRetVoid();
+    return;
+  }
+
+  Constant *totalFmt = utils::geti8StrVal(*M, "%llu BB(s) Executed\n", "fmt");
+  if (CountMode == CounterMode::Total) {
+    auto *bbValue = IRB.CreateLoad(i64Ty, IRB.CreateConstInBoundsGEP2_64(CountersTy, Counters, 0, 0), "bbValue");
+    IRB.CreateCall(printfFn, {totalFmt, bbValue});
+    if (!PathProfile) {
+      IRB.CreateRetVoid();
+      return;
+    }
+  }
+
+  SmallVector<Constant *, 16> fnNames;
+  for (auto *F : Fns) fnNames.push_back(utils::geti8StrVal(*M, F->getName().str().c_str(), "fn.name"));
+  auto *namesTy = ArrayType::get(IRB.getInt8PtrTy(), fnNames.size());
+  auto *namesGV = new GlobalVariable(*M, namesTy, true, GlobalValue::PrivateLinkage,
+                                     ConstantArray::get(namesTy, fnNames), "bbFnNames");
+
+  // one walk over the slices [Bases[i], Bases[i + 1]) of the counter array,
+  // Print(IRB, name, index in the slice, count) for each counter
+  auto dumpSlices = [&](ArrayRef<uint64_t> Bases, StringRef TableName,
+                        function_ref<void(IRBuilder<> &, Value *, Value *, Value *)> Print) {
+    SmallVector<Constant *, 16> bases;
+    for (auto base : Bases) bases.push_back(ConstantInt::get(i64Ty, base));
+    auto *basesTy = ArrayType::get(i64Ty, bases.size());
+    auto *basesGV = new GlobalVariable(*M, basesTy, true, GlobalValue::PrivateLinkage,
+                                       ConstantArray::get(basesTy, bases), TableName);
+    emitCountedLoop(IRB, IRB.getInt64(0), IRB.getInt64(Fns.size()), [&](IRBuilder<> &IRB, Value *fn) {
+      auto *name = IRB.CreateLoad(IRB.getInt8PtrTy(), IRB.CreateInBoundsGEP(namesTy, namesGV, {IRB.getInt64(0), fn}), "name");
+      auto *beg = IRB.CreateLoad(i64Ty, IRB.CreateInBoundsGEP(basesTy, basesGV, {IRB.getInt64(0), fn}), "beg");
+      auto *endIdx = IRB.CreateAdd(fn, IRB.getInt64(1));
+      auto *end = IRB.CreateLoad(i64Ty, IRB.CreateInBoundsGEP(basesTy, basesGV, {IRB.getInt64(0), endIdx}), "end");
+      emitCountedLoop(IRB, beg, end, [&](IRBuilder<> &IRB, Value *slot) {
+        auto *count = IRB.CreateLoad(i64Ty, IRB.CreateInBoundsGEP(CountersTy, Counters, {IRB.getInt64(0), slot}), "count");
+        Print(IRB, name, IRB.CreateSub(slot, beg), count);
+      });
+    });
+  };
+
+  // "<function> <slot> <count>" per slot, followed by the total in block
+  // mode (slots are blocks, or edge counters for bbprof.out in edge mode)
+  if (CountMode != CounterMode::Total) {
+    Constant *slotFmt = utils::geti8StrVal(*M, "%s %llu %llu\n", "fmt");
+    auto *total = IRBuilder<>(entryBB, entryBB->begin()).CreateAlloca(i64Ty, nullptr, "total");
+    IRB.CreateStore(IRB.getInt64(0), total);
+    dumpSlices(FnBase, "bbFnBase", [&](IRBuilder<> &IRB, Value *name, Value *slot, Value *count) {
+      IRB.CreateStore(IRB.CreateAdd(IRB.CreateLoad(i64Ty, total), count), total);
+      IRB.CreateCall(printfFn, {slotFmt, name, slot, count});
+    });
+    if (CountMode == CounterMode::Block) {
+      IRB.CreateCall(printfFn, {totalFmt, IRB.CreateLoad(i64Ty, total)});
+    }
+  }
+
+  // "<function> path <id> <count>" for the paths taken
+  if (PathProfile) {
+    Constant *pathFmt = utils::geti8StrVal(*M, "%s path %llu %llu\n", "fmt");
+    dumpSlices(PathBase, "bbPathBase", [&](IRBuilder<> &IRB, Value *name, Value *id, Value *count) {
+      auto *printBB = BasicBlock::Create(ctx, "print.path", &F);
+      auto *nextBB = BasicBlock::Create(ctx, "next.path", &F);
+      IRB.CreateCondBr(IRB.CreateICmpNE(count, IRB.getInt64(0)), printBB, nextBB);
+      IRB.SetInsertPoint(printBB);
+      IRB.CreateCall(printfFn, {pathFmt, name, id, count});
+      IRB.CreateBr(nextBB);
+      IRB.SetInsertPoint(nextBB);
+    });
+  }
+  IRB.CreateRetVoid();
+}
+
+/// folds every shard into shard 0, which is the one the dump reads
+void CountBBPass::emitShardMerge(IRBuilder<> &IRB) {
+  Type *i64Ty = IRB.getInt64Ty();
+  emitCountedLoop(IRB, IRB.getInt64(1), IRB.getInt64(NumShards), [&](IRBuilder<> &IRB, Value *shard) {
+    auto *shardBeg = IRB.CreateMul(shard, IRB.getInt64(ShardStride));
+    emitCountedLoop(IRB, IRB.getInt64(0), IRB.getInt64(NumSlots), [&](IRBuilder<> &IRB, Value *slot) {
+      auto *dst = IRB.CreateInBoundsGEP(CountersTy, Counters, {IRB.getInt64(0), slot});
+      auto *src = IRB.CreateInBoundsGEP(CountersTy, Counters, {IRB.getInt64(0), IRB.CreateAdd(shardBeg, slot)});
+      IRB.CreateStore(IRB.CreateAdd(IRB.CreateLoad(i64Ty, dst), IRB.CreateLoad(i64Ty, src)), dst);
+    });
+  });
+}
+
+void CountBBPass::emitProfileWrite(IRBuilder<> &IRB) {
+  Module *M = IRB.GetInsertBlock()->getModule();
+  LLVMContext &ctx = M->getContext();
+  Type *i8PtrTy = IRB.getInt8PtrTy();
+  Type *sizeTy = M->getDataLayout().getIntPtrType(ctx);
+  // FILE * is passed around as i8 *
+  FunctionCallee getenvFn = M->getOrInsertFunction("getenv", i8PtrTy, i8PtrTy);
+  FunctionCallee fopenFn = M->getOrInsertFunction("fopen", i8PtrTy, i8PtrTy, i8PtrTy);
+  FunctionCallee fwriteFn = M->getOrInsertFunction("fwrite", sizeTy, i8PtrTy, sizeTy, sizeTy, i8PtrTy);
+  FunctionCallee fcloseFn = M->getOrInsertFunction("fclose", IRB.getInt32Ty(), i8PtrTy);
+
+  auto *envPath = IRB.CreateCall(getenvFn, {utils::geti8StrVal(*M, "COUNT_BB_PROFILE", "env")});
+  auto *path = IRB.CreateSelect(IRB.CreateIsNull(envPath),
+                                utils::geti8StrVal(*M, k_defaultProfileStr, "path"), envPath, "path");
+  auto *file = IRB.CreateCall(fopenFn, {path, utils::geti8StrVal(*M, "wb", "mode")}, "file");
+
+  Function *F = IRB.GetInsertBlock()->getParent();
+  auto *writeBB = BasicBlock::Create(ctx, "write", F);
+  auto *doneBB = BasicBlock::Create(ctx, "done", F);
+  IRB.CreateCondBr(IRB.CreateIsNull(file), doneBB, writeBB);
+  IRB.SetInsertPoint(writeBB);
+  IRB.CreateCall(fwriteFn, {IRB.CreateBitCast(Profile, i8PtrTy), ConstantInt::get(sizeTy, ProfileSize),
+                            ConstantInt::get(sizeTy, 1), file});
+  IRB.CreateCall(fcloseFn, {file});
+  IRB.CreateBr(doneBB);
+  IRB.SetInsertPoint(doneBB);
+}
+
+/// slow path of the sampling countdown: returns the ticks it was armed with,
+/// the weight of the stretch about to be sampled, and rearms it to a length
+/// drawn uniformly from [1, 2 * period - 1]. A thread's first call arms it
+/// with the tick that got there as its first one, and returns 0 unless that
+/// tick already ran it out.
+void CountBBPass::create_sampleHit(Function &F) {
+  LLVMContext &ctx = F.getContext();
+  IRBuilder<> IRB(BasicBlock::Create(ctx, "entry", &F));
+  Type *i64Ty = IRB.getInt64Ty();
+  auto *firstBB = BasicBlock::Create(ctx, "first", &F);
+  auto *skipBB = BasicBlock::Create(ctx, "skip", &F);
+  auto *rearmBB = BasicBlock::Create(ctx, "rearm", &F);
+
+  // xorshift64, a fixed period would alias with the shape of the loops
+  auto draw = [&]() -> Value * {
+    Value *x = IRB.CreateLoad(i64Ty, Rng, "rng");
+    x = IRB.CreateXor(x, IRB.CreateShl(x, 13));
+    x = IRB.CreateXor(x, IRB.CreateLShr(x, 7));
+    x = IRB.CreateXor(x, IRB.CreateShl(x, 17));
+    IRB.CreateStore(x, Rng);
+    auto *period = IRB.CreateLoad(i64Ty, Period, "period");
+    auto *span = IRB.CreateSub(IRB.CreateShl(period, 1), IRB.getInt64(1));
+    return IRB.CreateAdd(IRB.CreateURem(x, span), IRB.getInt64(1), "countdown");
+  };
+
+  auto *armed = IRB.CreateLoad(i64Ty, Armed, "armed");
+  IRB.CreateCondBr(IRB.CreateICmpEQ(armed, IRB.getInt64(0)), firstBB, rearmBB);
+
+  // seeded from the address of the thread's own state, never 0
+  IRB.SetInsertPoint(firstBB);
+  auto *seed = IRB.CreateMul(IRB.CreatePtrToInt(Rng, i64Ty), IRB.getInt64(0x9e3779b97f4a7c15ULL));
+  IRB.CreateStore(IRB.CreateOr(seed, IRB.getInt64(1)), Rng);
+  auto *first = draw();
+  IRB.CreateStore(first, Armed);
+  IRB.CreateCondBr(IRB.CreateICmpEQ(first, IRB.getInt64(1)), rearmBB, skipBB);
+
+  IRB.SetInsertPoint(skipBB);
+  IRB.CreateStore(IRB.CreateSub(first, IRB.getInt64(1)), Countdown);
+  IRB.CreateRet(IRB.getInt64(0));
+
+  IRB.SetInsertPoint(rearmBB);
+  auto *weight = IRB.CreatePHI(i64Ty, 2, "weight");
+  weight->addIncoming(armed, &F.getEntryBlock());
+  weight->addIncoming(first, firstBB);
+  auto *next = draw();
+  IRB.CreateStore(next, Armed);
+  IRB.CreateStore(next, Countdown);
+  IRB.CreateRet(weight);
+}
+
+/// a constructor ahead of main, takes the period from $COUNT_BB_SAMPLE_PERIOD
+void CountBBPass::create_sampleInit(Function &F) {
+  Module *M = F.getParent();
+  LLVMContext &ctx = M->getContext();
+  IRBuilder<> IRB(BasicBlock::Create(ctx, "entry", &F));
+  Type *i8PtrTy = IRB.getInt8PtrTy();
+  FunctionCallee getenvFn = M->getOrInsertFunction("getenv", i8PtrTy, i8PtrTy);
+  FunctionCallee strtoullFn =
+      M->getOrInsertFunction("strtoull", IRB.getInt64Ty(), i8PtrTy, i8PtrTy->getPointerTo(), IRB.getInt32Ty());
+
+  auto *env = IRB.CreateCall(getenvFn, {utils::geti8StrVal(*M, "COUNT_BB_SAMPLE_PERIOD", "env")}, "env");
+  auto *parseBB = BasicBlock::Create(ctx, "parse", &F);
+  auto *setBB = BasicBlock::Create(ctx, "set", &F);
+  auto *doneBB = BasicBlock::Create(ctx, "done", &F);
+  IRB.CreateCondBr(IRB.CreateIsNull(env), doneBB, parseBB);
+  IRB.SetInsertPoint(parseBB);
+  auto *period = IRB.CreateCall(strtoullFn, {env, ConstantPointerNull::get(i8PtrTy->getPointerTo()),
+                                             IRB.getInt32(10)}, "period");
+  // 0 or garbage keeps the compiled-in period
+  IRB.CreateCondBr(IRB.CreateICmpSGT(period, IRB.getInt64(0)), setBB, doneBB);
+  IRB.SetInsertPoint(setBB);
+  IRB.CreateStore(period, Period);
+  IRB.CreateBr(doneBB);
+  IRB.SetInsertPoint(doneBB);
+  IRB.CreateRetVoid();
+}
+
+/// moves the static allocas of Entry to its top and returns the first
+/// instruction behind them, where code ahead of the function body can split
+/// the entry block without leaving allocas out of it
+static Instruction *hoistStaticAllocas(BasicBlock &Entry) {
+  auto isStaticAlloca = [](Instruction &I) {
+    auto *AI = dyn_cast<AllocaInst>(&I);
+    return AI && AI->isStaticAlloca();
+  };
+  Instruction *splitPt = &*find_if_not(Entry, isStaticAlloca);
+  for (Instruction &I : make_early_inc_range(make_range(splitPt->getIterator(), Entry.end()))) {
+    if (isStaticAlloca(I)) I.moveBefore(splitPt);
+  }
+  return splitPt;
+}
+
+/// the counting copy joins the original through PHIs at every checkpoint,
+/// which rules out block addresses, indirect and callbr branches, token
+/// values (funclet pads among them) and musttail calls
+static bool canDuplicate(Function const &F) {
+  for (auto const &B : F) {
+    if (B.hasAddressTaken()) return false;
+    for (auto const &I : B) {
+      if (I.getType()->isTokenTy() || isa<IndirectBrInst>(I) || isa<CallBrInst>(I)) return false;
+      auto *CI = dyn_cast<CallInst>(&I);
+      if (CI && CI->isMustTailCall()) return false;
+    }
+  }
+  return true;
+}
+
+/// sampling after Arnold and Ryder: the function body is duplicated, the
+/// original runs without counters and the copy updates every site. Function
+/// entry and the loop headers are checkpoints, each takes a tick off the
+/// countdown; when it runs out, the stretch up to the next checkpoint runs
+/// in the copy with every update weighted by the ticks the countdown took.
+/// The countdown lives in a local promoted to a register, synced with the
+/// thread-local one around calls and at the function's exits only.
+void CountBBPass::emitSamples(Function &F, ArrayRef<CounterSite> Sites) {
+  SmallVector<std::pair<const BasicBlock *, const BasicBlock *>, 8> backEdges;
+  FindFunctionBackedges(F, backEdges);
+  SetVector<BasicBlock *> headers;
+  for (auto const &E : backEdges) headers.insert(const_cast<BasicBlock *>(E.second));
+  if (!canDuplicate(F) || any_of(headers, [](BasicBlock *H) { return H->isEHPad(); })) {
+    for (auto const &site : Sites) {
+      IRBuilder<> IRB(site.InsertPt);
+      emitAdd(IRB, nullptr, site.Slot, site.Offset, IRB.getInt64(1));
+    }
+    return;
+  }
+
+  LLVMContext &ctx = F.getContext();
+  BasicBlock *entry = &F.getEntryBlock();
+  entry->splitBasicBlock(hoistStaticAllocas(*entry));
+  IRBuilder<> IRB(entry, entry->begin());
+  Type *i64Ty = IRB.getInt64Ty();
+  auto *local = IRB.CreateAlloca(i64Ty, nullptr, "countdown.local");
+  auto *weight = IRB.CreateAlloca(i64Ty, nullptr, "sample.weight");
+  IRB.SetInsertPoint(entry->getTerminator());
+  IRB.CreateStore(IRB.CreateLoad(i64Ty, Countdown, "countdown"), local);
+
+  // the checks are the entry block and the phis of each loop header, split
+  // off the rest of it; they are not copied, so every loop of either copy
+  // is entered through the check in its original header
+  SetVector<BasicBlock *> checks;
+  checks.insert(entry);
+  for (auto *H : headers) {
+    H->splitBasicBlock(H->getFirstNonPHI());
+    checks.insert(H);
+  }
+
+  SmallVector<BasicBlock *, 16> blocks;
+  for (auto &B : F) {
+    if (!checks.count(&B)) blocks.push_back(&B);
+  }
+  ValueToValueMapTy VMap;
+  SmallVector<BasicBlock *, 16> copies;
+  for (auto *B : blocks) {
+    copies.push_back(CloneBasicBlock(B, VMap, ".sampled", &F));
+    VMap[B] = copies.back();
+  }
+  // the checks and the allocas are left out of VMap and stay shared
+  for (auto *B : copies) {
+    for (auto &I : *B) RemapInstruction(&I, VMap, RF_NoModuleLevelChanges | RF_IgnoreMissingLocals);
+  }
+  for (auto *H : headers) {
+    for (PHINode &PN : H->phis()) {
+      for (unsigned i = 0, e = PN.getNumIncomingValues(); i != e; ++i) {
+        PN.addIncoming(PN.getIncomingValue(i), cast<BasicBlock>(VMap[PN.getIncomingBlock(i)]));
+      }
+    }
+  }
+  SmallVector<std::pair<Instruction *, Instruction *>, 64> defs;
+  for (auto *B : blocks) {
+    for (auto &I : *B) {
+      if (!I.use_empty()) defs.push_back({&I, cast<Instruction>(VMap[&I])});
+    }
+  }
+
+  for (auto const &site : Sites) {
+    IRBuilder<> IRB(cast<Instruction>(VMap[site.InsertPt]));
+    Value *offset = site.Offset;
+    if (offset && VMap.count(offset)) offset = VMap[offset];
+    emitAdd(IRB, nullptr, site.Slot, offset, IRB.CreateLoad(i64Ty, weight, "sample.weight"));
+  }
+
+  for (auto *check : checks) {
+    auto *fast = check->getSingleSuccessor();
+    auto *sampled = cast<BasicBlock>(VMap[fast]);
+    auto *hitBB = BasicBlock::Create(ctx, "sample.hit", &F, sampled);
+    check->getTerminator()->eraseFromParent();
+    IRB.SetInsertPoint(check);
+    auto *left = IRB.CreateSub(IRB.CreateLoad(i64Ty, local), IRB.getInt64(1), "countdown.next");
+    IRB.CreateStore(left, local);
+    IRB.CreateCondBr(IRB.CreateICmpEQ(left, IRB.getInt64(0), "sample.hit"), hitBB, fast,
+                     MDBuilder(ctx).createBranchWeights(1, SamplePeriod));
+
+    // a thread's first checkpoint only arms the countdown, its stretch is
+    // counted with weight 0
+    IRB.SetInsertPoint(hitBB);
+    auto *ticks = IRB.CreateCall(SampleHit, {}, "sample.ticks");
+    IRB.CreateStore(ticks, weight);
+    IRB.CreateStore(IRB.CreateLoad(i64Ty, Countdown, "countdown"), local);
+    IRB.CreateBr(sampled);
+  }
+
+  // both copies of a value reach the checks and whatever follows them
+  SSAUpdater SSA;
+  for (auto const &def : defs) {
+    SmallVector<Use *, 8> uses;
+    for (auto *I : {def.first, def.second}) {
+      for (auto &U : I->uses()) {
+        auto *user = cast<Instruction>(U.getUser());
+        if (user->getParent() != I->getParent() || isa<PHINode>(user)) uses.push_back(&U);
+      }
+    }
+    if (uses.empty()) continue;
+    SSA.Initialize(def.first->getType(), def.first->getName());
+    SSA.AddAvailableValue(def.first->getParent(), def.first);
+    SSA.AddAvailableValue(def.second->getParent(), def.second);
+    for (auto *U : uses) SSA.RewriteUse(*U);
+  }
+
+  SmallVector<Instruction *, 16> syncPts;
+  for (auto &B : F) {
+    for (auto &I : B) {
+      auto *CB = dyn_cast<CallBase>(&I);
+      if (CB && (isa<IntrinsicInst>(CB) || CB->getCalledFunction() == SampleHit)) continue;
+      if (CB || isa<ReturnInst>(&I) || isa<ResumeInst>(&I)) syncPts.push_back(&I);
+    }
+  }
+  for (auto *I : syncPts) {
+    IRB.SetInsertPoint(I);
+    IRB.CreateStore(IRB.CreateLoad(i64Ty, local), Countdown);
+    // the callee may have counted down too; an invoke resumes elsewhere
+    if (isa<CallInst>(I)) {
+      IRB.SetInsertPoint(I->getNextNode());
+      IRB.CreateStore(IRB.CreateLoad(i64Ty, Countdown, "countdown"), local);
+    }
+  }
+
+  DominatorTree DT(F);
+  PromoteMemToReg({local, weight}, DT);
+}
+
+/// hands out shards to threads round-robin on their first instrumented call
+void CountBBPass::create_shardInit(Function &F) {
+  auto *M = F.getParent();
+  LLVMContext &ctx = M->getContext();
+  IRBuilder<> IRB(BasicBlock::Create(ctx, "entry", &F));
+  auto *nextShard = new GlobalVariable(*M, IRB.getInt64Ty(), false, GlobalValue::PrivateLinkage,
+                                       IRB.getInt64(0), "bbShardNext");
+  auto *ticket = IRB.CreateAtomicRMW(AtomicRMWInst::Add, nextShard, IRB.getInt64(1), MaybeAlign(8),
+                                     AtomicOrdering::Monotonic);
+  auto *shard = IRB.CreateURem(ticket, IRB.getInt64(NumShards), "shard");
+  auto *base = IRB.CreateInBoundsGEP(CountersTy, Counters,
+                                     {IRB.getInt64(0), IRB.CreateMul(shard, IRB.getInt64(ShardStride))}, "shard.base");
+  IRB.CreateStore(base, ShardTLS);
+  IRB.CreateRet(base);
+}
+
+/// loads the shard of the current thread at function entry, the entry block
+/// is split behind its static allocas, EntryTail is set to the block that
+/// now holds the original entry terminator
+Value *CountBBPass::emitShardPrologue(Function &F, BasicBlock *&EntryTail) {
+  BasicBlock &entry = F.getEntryBlock();
+  Instruction *splitPt = hoistStaticAllocas(entry);
+
+  IRBuilder<> IRB(splitPt);
+  auto *ptrTy = IRB.getInt64Ty()->getPointerTo();
+  auto *cached = IRB.CreateLoad(ptrTy, ShardTLS, "shard.cached");
+  auto *isNull = IRB.CreateICmpEQ(cached, ConstantPointerNull::get(ptrTy));
+  Instruction *initTerm = SplitBlockAndInsertIfThen(isNull, splitPt, false);
+  IRB.SetInsertPoint(initTerm);
+  auto *fresh = IRB.CreateCall(ShardInit, {}, "shard.fresh");
+
+  EntryTail = splitPt->getParent();
+  IRB.SetInsertPoint(&EntryTail->front());
+  auto *base = IRB.CreatePHI(ptrTy, 2, "shard.base");
+  base->addIncoming(cached, &entry);
+  base->addIncoming(fresh, initTerm->getParent());
+  return base;
+}
+
+Value *CountBBPass::slotAddr(IRBuilder<> &IRB, Value *ShardBase, uint64_t Slot, Value *Offset) {
+  if (Offset) {
+    auto *slot = IRB.CreateAdd(IRB.getInt64(Slot), Offset, "slot");
+    if (ShardBase) return IRB.CreateInBoundsGEP(IRB.getInt64Ty(), ShardBase, slot);
+    return IRB.CreateInBoundsGEP(CountersTy, Counters, {IRB.getInt64(0), slot});
+  }
+  if (ShardBase) return IRB.CreateConstInBoundsGEP1_64(IRB.getInt64Ty(), ShardBase, Slot);
+  return IRB.CreateConstInBoundsGEP2_64(CountersTy, Counters, 0, Slot);
+}
+
 bool CountBBPass::setup(Module &M) {
 
   auto *Main = M.getFunction("main");
@@ -62,58 +665,313 @@ bool CountBBPass::setup(Module &M) {
     std::exit(1);
   }
 
-  Type *i64Ty = TypeBuilder<types::i<64>, false>::get(ctx);
+  // lay out one dense slice per function, in module order
+  FnBase.push_back(0);
+  std::vector<uint64_t> checksums;
+  for (auto &F : M) {
+    if (F.isDeclaration()) continue;
+    Fns.push_back(&F);
+    checksums.push_back(bbprof::cfgChecksum(F));
+    uint64_t numSlots = CountMode == CounterMode::Block ? F.size() : 0;
+    if (CountMode == CounterMode::Edge) {
+      // plan on the untouched CFG, it is what bbprof.out recomputes
+      Plans.push_back(std::make_unique<EdgeProfilePlan>(F));
+      numSlots = Plans.back()->isValid() ? Plans.back()->getNumCounters() : F.size();
+    }
+    FnBase.push_back(FnBase.back() + numSlots);
+  }
+  NumSlots = CountMode == CounterMode::Total ? 1 : FnBase.back();
+
+  PathBase.push_back(NumSlots);
+  for (auto *F : Fns) {
+    uint64_t numPaths = 0;
+    if (PathProfile) {
+      PathPlans.push_back(std::make_unique<PathNumbering>(*F));
+      auto const &plan = *PathPlans.back();
+      if (plan.isValid() && plan.getNumPaths().ule(MaxPaths)) numPaths = plan.getNumPaths().getZExtValue();
+    }
+    PathBase.push_back(PathBase.back() + numPaths);
+  }
+  NumSlots = PathBase.back();
+
+  // shards are laid out back to back, each starting on its own cache line
+  uint64_t numShards = 1;
+  if (CountStrategy == CounterStrategy::Shard) {
+    if (NumShards == 0) {
+      std::fprintf(stderr, "-count-bb-shards must be positive\n");
+      std::exit(1);
+    }
+    ShardStride = alignTo(NumSlots, k_slotsPerLine);
+    numShards = NumShards;
+  }
+
+  Type *i64Ty = Type::getInt64Ty(ctx);
+  Type *i32Ty = Type::getInt32Ty(ctx);
+  CountersTy = ArrayType::get(i64Ty, numShards == 1 ? NumSlots : numShards * ShardStride);
 
-  auto bbCounter = new GlobalVariable(M, i64Ty, false, GlobalValue::ExternalLinkage,
-                                      ConstantInt::get(i64Ty, 0), "bbCounter");
+  // the profile image: header, function table, padding to a cache line, counters
+  auto *headerTy = StructType::get(ctx, {i64Ty, i32Ty, i32Ty, i64Ty, i64Ty, i64Ty});
+  auto *recordTy = StructType::get(ctx, {i64Ty, i64Ty, i64Ty, i64Ty, i64Ty, i64Ty});
+  auto *tableTy = ArrayType::get(recordTy, Fns.size());
+  uint64_t tableEnd = sizeof(bbprof::Header) + Fns.size() * sizeof(bbprof::FunctionRecord);
+  auto *padTy = ArrayType::get(i64Ty, (alignTo(tableEnd, k_slotsPerLine * 8) - tableEnd) / 8);
+  auto *imageTy = StructType::get(ctx, {headerTy, tableTy, padTy, CountersTy});
+  uint64_t countersOffset = M.getDataLayout().getStructLayout(imageTy)->getElementOffset(3);
+  ProfileSize = countersOffset + NumSlots * 8;
+
+  auto *header = ConstantStruct::get(
+      headerTy, {ConstantInt::get(i64Ty, bbprof::k_magic), ConstantInt::get(i32Ty, bbprof::k_version),
+                 ConstantInt::get(i32Ty, (unsigned)CountMode.getValue()), ConstantInt::get(i64Ty, Fns.size()),
+                 ConstantInt::get(i64Ty, NumSlots), ConstantInt::get(i64Ty, countersOffset)});
+  SmallVector<Constant *, 16> records;
+  for (unsigned i = 0; i < Fns.size(); ++i) {
+    records.push_back(ConstantStruct::get(
+        recordTy, {ConstantInt::get(i64Ty, bbprof::functionHash(Fns[i]->getName())),
+                   ConstantInt::get(i64Ty, checksums[i]), ConstantInt::get(i64Ty, FnBase[i]),
+                   ConstantInt::get(i64Ty, FnBase[i + 1] - FnBase[i]), ConstantInt::get(i64Ty, PathBase[i]),
+                   ConstantInt::get(i64Ty, PathBase[i + 1] - PathBase[i])}));
+  }
+  auto *image = ConstantStruct::get(imageTy, {header, ConstantArray::get(tableTy, records),
+                                              ConstantAggregateZero::get(padTy),
+                                              ConstantAggregateZero::get(CountersTy)});
+  Profile = new GlobalVariable(M, imageTy, false, GlobalValue::ExternalLinkage, image, bbProfileStr);
+  Profile->setAlignment(Align(k_slotsPerLine * 8));
+  Counters = ConstantExpr::getInBoundsGetElementPtr(
+      imageTy, Profile, ArrayRef<Constant *>{ConstantInt::get(i32Ty, 0), ConstantInt::get(i32Ty, 3)});
+
+  if (CountStrategy == CounterStrategy::Shard) {
+    auto *ptrTy = i64Ty->getPointerTo();
+    ShardTLS = new GlobalVariable(M, ptrTy, false, GlobalValue::PrivateLinkage,
+                                  ConstantPointerNull::get(ptrTy), "bbShard", nullptr,
+                                  GlobalValue::InitialExecTLSModel);
+    ShardInit = Function::Create(FunctionType::get(ptrTy, false), GlobalValue::PrivateLinkage,
+                                 k_shardInitStr, M);
+    create_shardInit(*ShardInit);
+  }
+
+  if (CountStrategy == CounterStrategy::Sample) {
+    if (SamplePeriod == 0) {
+      std::fprintf(stderr, "-count-bb-sample-period must be positive\n");
+      std::exit(1);
+    }
+    Period = new GlobalVariable(M, i64Ty, false, GlobalValue::PrivateLinkage,
+                                ConstantInt::get(i64Ty, SamplePeriod), "bbSamplePeriod");
+    // the countdown never drops below 0, it starts at 1 so the thread's
+    // first checkpoint runs it out and arms the rest
+    auto makeTLS = [&](char const *Name, uint64_t Init) {
+      return new GlobalVariable(M, i64Ty, false, GlobalValue::PrivateLinkage, ConstantInt::get(i64Ty, Init), Name,
+                                nullptr, GlobalValue::InitialExecTLSModel);
+    };
+    Countdown = makeTLS("bbSampleCountdown", 1);
+    Armed = makeTLS("bbSampleArmed", 0);
+    Rng = makeTLS("bbSampleRng", 0);
+    SampleHit = Function::Create(FunctionType::get(i64Ty, false), GlobalValue::PrivateLinkage, k_sampleHitStr, M);
+    SampleHit->addFnAttr(Attribute::Cold);
+    SampleHit->addFnAttr(Attribute::NoInline);
+    create_sampleHit(*SampleHit);
+  }
 
   // create a call to the bb tracking callback function
-  auto *aexitCall = cast<Function>(M.getOrInsertFunction(k_atexitCallStr, TypeBuilder<void(void), false>::get(ctx)));
+  auto *aexitCall = cast<Function>(
+      M.getOrInsertFunction(k_atexitCallStr, FunctionType::get(Type::getVoidTy(ctx), false)).getCallee());
 
   // set the attribute of the atexit
-  auto atexit_attr = AttributeList().addAttribute(ctx, ~0U, Attribute::NoUnwind);
+  auto atexit_attr = AttributeList().addFnAttribute(ctx, Attribute::NoUnwind);
   // signature of atexitFn
-  auto *atexitFn =
-      cast<Function>(M.getOrInsertFunction("atexit", TypeBuilder<int(void(void)), false>::get(ctx), atexit_attr));
+  FunctionType *atexitTy = FunctionType::get(Type::getInt32Ty(ctx), {aexitCall->getType()}, false);
+  FunctionCallee atexitFn = M.getOrInsertFunction("atexit", atexitTy, atexit_attr);
 
   Instruction &I = Main->front().front();
-  CallInst::Create(atexitFn, aexitCall, "", &I);
+  CallInst::Create(atexitFn, {aexitCall}, "", &I);
+
+  if (CountStrategy == CounterStrategy::Sample) {
+    auto *sampleInit = Function::Create(FunctionType::get(Type::getVoidTy(ctx), false),
+                                        GlobalValue::PrivateLinkage, k_sampleInitStr, M);
+    create_sampleInit(*sampleInit);
+    // main's own entry is a checkpoint, the period has to be read before it
+    appendToGlobalCtors(M, sampleInit, 0);
+  }
 
-  create_atexitCall(*aexitCall, bbCounter);
+  create_atexitCall(*aexitCall);
 
   return true;
 }
 
-bool CountBBPass::runOnBasicBlock(BasicBlock &BB, Module &M) {
+void CountBBPass::emitAdd(IRBuilder<> &IRB, Value *ShardBase, uint64_t Slot, Value *Offset, Value *Delta) {
+  auto *counter = slotAddr(IRB, ShardBase, Slot, Offset);
 
-  // get the variable according to variable name, the value is default to 0
-  auto *bbCounter = M.getGlobalVariable(bbCounterStr);
-  assert(bbCounter && "Error: unable to get BasicBlock counter");
-
-  // insert at the end of the current bb (before the terminator)
-  auto *insertPos = BB.getTerminator();
+  if (CountStrategy != CounterStrategy::Plain) {
+    IRB.CreateAtomicRMW(AtomicRMWInst::Add, counter, Delta, MaybeAlign(8), AtomicOrdering::Monotonic);
+    return;
+  }
 
-  // load the value of bbCounter
-  auto *oldCounter = new LoadInst(bbCounter, "old.bb.count", insertPos);
-  // inc 1 of the counter and store
-  auto *newCounter = BinaryOperator::Create(
-      Instruction::Add, oldCounter,
-      ConstantInt::get(Type::getInt64Ty(BB.getContext()), 1), "new.bb.count",
-      insertPos);
+  // load the value of the counter
+  auto *oldCounter = IRB.CreateLoad(IRB.getInt64Ty(), counter, "old.bb.count");
+  // add to the counter and store
+  auto *newCounter = IRB.CreateAdd(oldCounter, Delta, "new.bb.count");
   // insert store inst
-  new StoreInst(newCounter, bbCounter, insertPos);
+  IRB.CreateStore(newCounter, counter);
+}
+
+/// emits the counter updates once the CFG is final; with -count-bb-promote
+/// an update inside a promotable loop bumps a per-(loop, slot) local that
+/// mem2reg turns into registers, and each exit block of the loop adds the
+/// local to memory and resets it
+void CountBBPass::emitCounters(Function &F, ArrayRef<CounterSite> Sites, Value *ShardBase) {
+  if (CountStrategy == CounterStrategy::Sample) {
+    // the counting copy only runs when sampled, nothing to promote
+    emitSamples(F, Sites);
+    return;
+  }
+
+  if (!PromoteLoops) {
+    for (auto const &site : Sites) {
+      IRBuilder<> IRB(site.InsertPt);
+      emitAdd(IRB, ShardBase, site.Slot, site.Offset, IRB.getInt64(1));
+    }
+    return;
+  }
+
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  DenseMap<Loop *, bool> promotable;
+  MapVector<std::pair<Loop *, uint64_t>, AllocaInst *> locals;
+  BasicBlock &entry = F.getEntryBlock();
+  IRBuilder<> entryIRB(&entry, entry.getFirstInsertionPt());
+  for (auto const &site : Sites) {
+    IRBuilder<> IRB(site.InsertPt);
+    Loop *L = LI.getLoopFor(site.InsertPt->getParent());
+    if (L && !promotable.count(L)) promotable[L] = isPromotable(L);
+    // path counters are picked at run time, they stay in memory
+    if (!L || !promotable[L] || site.Offset) {
+      emitAdd(IRB, ShardBase, site.Slot, site.Offset, IRB.getInt64(1));
+      continue;
+    }
+    auto &local = locals[{L, site.Slot}];
+    if (!local) {
+      // zero on entry, so exit blocks reached from outside the loop add 0
+      local = entryIRB.CreateAlloca(IRB.getInt64Ty(), nullptr, "bb.count.reg");
+      entryIRB.CreateStore(IRB.getInt64(0), local);
+    }
+    auto *old = IRB.CreateLoad(IRB.getInt64Ty(), local, "old.bb.count.reg");
+    IRB.CreateStore(IRB.CreateAdd(old, IRB.getInt64(1), "new.bb.count.reg"), local);
+  }
+
+  SmallVector<AllocaInst *, 16> allocas;
+  for (auto &entryLocal : locals) {
+    Loop *L = entryLocal.first.first;
+    AllocaInst *local = entryLocal.second;
+    SmallVector<BasicBlock *, 4> exits;
+    L->getUniqueExitBlocks(exits);
+    for (auto *exit : exits) {
+      IRBuilder<> IRB(exit, exit->getFirstInsertionPt());
+      emitAdd(IRB, ShardBase, entryLocal.first.second, nullptr,
+              IRB.CreateLoad(IRB.getInt64Ty(), local, "loop.count"));
+      IRB.CreateStore(IRB.getInt64(0), local);
+    }
+    allocas.push_back(local);
+  }
+  PromoteMemToReg(allocas, DT);
+}
+
+bool CountBBPass::runOnBasicBlock(BasicBlock &BB, uint64_t Slot, SmallVectorImpl<CounterSite> &Sites) {
+
+  // count at the end of the current bb (before the terminator)
+  Sites.push_back({BB.getTerminator(), Slot});
 
   return true;
 }
 
+/// where code for the original edge Src -> Dst goes; the shard prologue
+/// moved the entry terminator into EntryTail, and a split edge is split once
+static Instruction *edgeInsertPt(BasicBlock *Src, BasicBlock *Dst, EdgeProfilePlan::Placement Where,
+                                 BasicBlock *EntryTail, EdgeSplits &Splits) {
+  BasicBlock *entry = &EntryTail->getParent()->getEntryBlock();
+  BasicBlock *src = Src == entry ? EntryTail : Src;
+  if (Where == EdgeProfilePlan::InSrc) return src->getTerminator();
+  if (Where == EdgeProfilePlan::InDst) return &*Dst->getFirstInsertionPt();
+  auto &mid = Splits[{Src, Dst}];
+  if (!mid) {
+    Instruction *TI = src->getTerminator();
+    mid = SplitCriticalEdge(TI, GetSuccessorNumber(src, Dst), CriticalEdgeSplittingOptions().setMergeIdenticalEdges());
+    assert(mid && "planned edge split failed");
+  }
+  return mid->getTerminator();
+}
+
+bool CountBBPass::runOnEdges(EdgeProfilePlan const &Plan, uint64_t Base, BasicBlock *EntryTail, EdgeSplits &Splits,
+                             SmallVectorImpl<CounterSite> &Sites) {
+  for (auto const &E : Plan.edges()) {
+    if (E.Counter < 0) continue;
+    Sites.push_back({edgeInsertPt(E.Src, E.Dst, E.Where, EntryTail, Splits), Base + E.Counter});
+  }
+  return true;
+}
+
+/// Ball-Larus instrumentation: the path register starts at 0, forward edges
+/// add their increment, back edges and exits count the path in the register.
+/// Returns the register, to be promoted once the CFG is final.
+AllocaInst *CountBBPass::runOnPaths(PathNumbering const &Plan, uint64_t Base, BasicBlock *EntryTail,
+                                    EdgeSplits &Splits, SmallVectorImpl<CounterSite> &Sites) {
+  BasicBlock &entry = EntryTail->getParent()->getEntryBlock();
+  IRBuilder<> entryIRB(&entry, entry.getFirstInsertionPt());
+  Type *i64Ty = entryIRB.getInt64Ty();
+  auto *path = entryIRB.CreateAlloca(i64Ty, nullptr, "bl.path");
+  entryIRB.CreateStore(entryIRB.getInt64(0), path);
+
+  // code at the top of a block has to run before the code on its way out,
+  // which may share the insertion point when the block is a lone branch
+  auto emitActions = [&](bool AtDst) {
+    for (auto const &A : Plan.actions()) {
+      if ((A.Where == EdgeProfilePlan::InDst) != AtDst) continue;
+      IRBuilder<> IRB(edgeInsertPt(A.Src, A.Dst, A.Where, EntryTail, Splits));
+      auto *cur = IRB.CreateLoad(i64Ty, path, "bl.path.cur");
+      if (!A.IsBackEdge) {
+        IRB.CreateStore(IRB.CreateAdd(cur, IRB.getInt64(A.Inc.getZExtValue())), path);
+        continue;
+      }
+      Sites.push_back({&*IRB.GetInsertPoint(), Base, IRB.CreateAdd(cur, IRB.getInt64(A.Inc.getZExtValue()))});
+      IRB.CreateStore(IRB.getInt64(A.Reset.getZExtValue()), path);
+    }
+  };
+  emitActions(true);
+  emitActions(false);
+  for (auto *B : Plan.exits()) {
+    IRBuilder<> IRB(B == &entry ? EntryTail->getTerminator() : B->getTerminator());
+    Sites.push_back({&*IRB.GetInsertPoint(), Base, IRB.CreateLoad(i64Ty, path, "bl.path.cur")});
+  }
+  return path;
+}
+
 bool CountBBPass::runOnModule(Module &M) {
 
   setup(M);
-  for (auto &F : M) {
-    // skip analysis on the instrumented function
-    if (F.getName() == k_atexitCallStr) continue;
-    for (auto &B : F) {
-      runOnBasicBlock(B, M);
+  for (unsigned i = 0; i < Fns.size(); ++i) {
+    uint64_t slot = FnBase[i];
+    // the shard prologue adds blocks, only the original ones are counted
+    SmallVector<BasicBlock *, 16> blocks;
+    for (auto &B : *Fns[i]) blocks.push_back(&B);
+    Value *shardBase = nullptr;
+    if (CountStrategy == CounterStrategy::Shard) {
+      shardBase = emitShardPrologue(*Fns[i], blocks.front());
+    }
+    SmallVector<CounterSite, 16> sites;
+    EdgeSplits splits;
+    if (CountMode == CounterMode::Edge && Plans[i]->isValid()) {
+      runOnEdges(*Plans[i], slot, blocks.front(), splits, sites);
+    } else {
+      for (auto *B : blocks) {
+        runOnBasicBlock(*B, CountMode == CounterMode::Total ? 0 : slot++, sites);
+      }
+    }
+    AllocaInst *path = nullptr;
+    if (PathBase[i + 1] != PathBase[i]) {
+      path = runOnPaths(*PathPlans[i], PathBase[i], blocks.front(), splits, sites);
+    }
+    emitCounters(*Fns[i], sites, shardBase);
+    if (path) {
+      DominatorTree DT(*Fns[i]);
+      PromoteMemToReg({path}, DT);
     }
   }
   return true;
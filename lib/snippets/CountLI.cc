@@ -3,15 +3,32 @@
 //
 
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
 
 #include "llvm/Pass.h"
 #include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_os_ostream.h"
 
 #include "llvm/IR/CFG.h"
 
+#include "LoopCost.hh"
+#include "LoopNest.hh"
+
 using namespace llvm;
 
+static cl::opt<bool> Jsonl("count-li-jsonl",
+                           cl::desc("One {\"rec\":\"loop\"} JSON record per loop, see LoopNestReport"),
+                           cl::init(false));
+static cl::opt<unsigned> Hot("count-li-hot",
+                             cl::desc("After the last function, rank the loops of the module by their static "
+                                      "cost and print the N hottest, see LoopCost"),
+                             cl::value_desc("N"), cl::init(0));
+
+/// the loop nest of every function with its SCEV trip counts; `ir_dump.out
+/// --loops -j N` reports the same for many functions or files at once, and
+/// `--hot-loops=N` ranks them across files as -count-li-hot does per module
 class CountLD : public FunctionPass {
 public:
   static char ID;
@@ -21,34 +38,40 @@ public:
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.setPreservesAll();
     AU.addRequired<LoopInfoWrapperPass>();
+    AU.addRequired<ScalarEvolutionWrapperPass>();
   }
 
   virtual bool runOnFunction(Function &F) override {
-    errs() << "\nFunc: " << F.getName() << "\n";
     LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-    if (LI.empty()) {
+    LoopNestReport report(F, LI);
+    report.addTripCounts(getAnalysis<ScalarEvolutionWrapperPass>().getSE());
+    if (Hot) collectHotLoops(report, computeLoopCosts(report), F.getParent()->getModuleIdentifier(), HotLoops);
+    if (Jsonl) {
+      report.writeJsonl(outs());
+      return false;
+    }
+    errs() << "\nFunc: " << F.getName() << "\n";
+    if (report.empty()) {
       errs() << "no loop inside\n";
     } else {
-      for (BasicBlock &B: F) {
-        errs() << "BB: " << B.getName() << "\n";
-        Loop *li = LI.getLoopFor(&B);
-        if (li != nullptr) {
-          auto predBB = li->getLoopPreheader();
-          if (predBB != nullptr) {
-            errs() << "\tpred:" << predBB->getName() << "\n";
-          }
-          auto preHeader = li->getLoopPreheader();
-          if (preHeader != nullptr) {
-            errs() << "\tpreheader:" << preHeader->getName() << "\n";
-          }
-        }
-      }
+      report.print(errs());
     }
     return false;
   }
 
+  bool doFinalization(Module &M) override {
+    if (!Hot) return false;
+    rankHotLoops(HotLoops, Hot);
+    if (!Jsonl) errs() << "\nHot loops of " << M.getModuleIdentifier() << ":\n";
+    printHotLoops(Jsonl ? outs() : errs(), HotLoops, Jsonl);
+    HotLoops.clear();
+    return false;
+  }
+
+private:
+  std::vector<HotLoop> HotLoops;
 };
 
 char CountLD::ID = 0;
 
-static RegisterPass<CountLD> X("count-li", "count loop info", true, true);
\ No newline at end of file
+static RegisterPass<CountLD> X("count-li", "count loop info", true, true);
@@ -1,61 +1,197 @@
+
 #include "llvm/IR/Function.h"
 
 #include "llvm/Pass.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_os_ostream.h"
 
 #include "llvm/IR/CFG.h"
 
-#include <set>
+#include "BBProfile.hh"
+#include "LLDump.hh"
+#include "PathProfile.hh"
+#include "Reachability.hh"
+
+#include <vector>
 
 using namespace llvm;
 
+namespace {
+enum class PathMode { Reach, Paths };
+
+static cl::opt<PathMode> Mode(
+    "cfg-path-mode", cl::desc("What cfg-path prints per function"),
+    cl::init(PathMode::Reach),
+    cl::values(clEnumValN(PathMode::Reach, "reach", "for every block, the blocks it can reach"),
+               clEnumValN(PathMode::Paths, "paths",
+                          "the number of Ball-Larus (acyclic) paths and some of them decoded")));
+
+static cl::opt<unsigned> ListPaths(
+    "cfg-path-list",
+    cl::desc("Paths decoded per function with -cfg-path-mode=paths, the "
+             "lowest IDs, or the hottest ones with -cfg-path-profile"),
+    cl::init(10));
+
+static cl::opt<std::string> PathProfileFile(
+    "cfg-path-profile",
+    cl::desc("Output of a program instrumented with count-bb -count-bb-paths, "
+             "the text dump or the binary profile"),
+    cl::value_desc("filename"));
+}  // namespace
+
 namespace llvm {
 
 class DumpCFGPath : public FunctionPass {
  public:
   static char ID;
-  typedef std::set<BasicBlock *> BBVisitInfo;
 
   void getAnalysisUsage(AnalysisUsage &AU) const override {
     AU.setPreservesAll();
+    if (Mode == PathMode::Reach) AU.addRequired<ReachabilityWrapperPass>();
   }
 
   DumpCFGPath() : FunctionPass(ID) {}
 
-  bool hasPath(BasicBlock *bb1, BasicBlock *bb2, BBVisitInfo visited) {
-    visited.insert(bb1);
-    bool reachable = false;
-    if (bb1 == bb2) {
-      return true;
+  /// path ID and count of the paths taken, per function name hash
+  DenseMap<uint64_t, std::vector<std::pair<uint64_t, uint64_t>>> PathCounts;
+  /// CFG checksums of the functions in a binary profile
+  DenseMap<uint64_t, uint64_t> Checksums;
+
+  bool doInitialization(Module &M) override {
+    if (Mode != PathMode::Paths || PathProfileFile.empty()) return false;
+    auto file = MemoryBuffer::getFile(PathProfileFile);
+    if (!file) {
+      errs() << PathProfileFile << ": " << file.getError().message() << "\n";
+      std::exit(1);
     }
-    for (succ_iterator pi = succ_begin(bb1); pi != succ_end(bb1); pi++) {
-      if (visited.find(*pi) == visited.end()) {
-        reachable = hasPath(*pi, bb2, visited);
-        if (reachable) {
-          return true;
+    StringRef buffer = file.get()->getBuffer();
+
+    if (buffer.size() >= sizeof(uint64_t) && *reinterpret_cast<uint64_t const *>(buffer.data()) == bbprof::k_magic) {
+      auto profile = bbprof::readProfile(buffer);
+      if (!profile) {
+        logAllUnhandledErrors(profile.takeError(), errs(), PathProfileFile + ": ");
+        std::exit(1);
+      }
+      for (auto const &R : profile->Functions) {
+        Checksums[R.NameHash] = R.CFGChecksum;
+        auto counters = profile->pathCountersOf(R);
+        for (uint64_t id = 0; id < counters.size(); ++id) {
+          if (counters[id]) PathCounts[R.NameHash].push_back({id, counters[id]});
         }
       }
+      return false;
+    }
+
+    // "<function> path <id> <count>" lines of the text dump
+    SmallVector<StringRef, 4> fields;
+    while (!buffer.empty()) {
+      StringRef line;
+      std::tie(line, buffer) = buffer.split('\n');
+      fields.clear();
+      line.split(fields, ' ', -1, false);
+      uint64_t id, count;
+      if (fields.size() != 4 || fields[1] != "path" || fields[2].getAsInteger(10, id) ||
+          fields[3].getAsInteger(10, count))
+        continue;
+      PathCounts[bbprof::functionHash(fields[0])].push_back({id, count});
     }
-    return reachable;
+    return false;
+  }
+
+  void printPath(raw_ostream &OS, PathNumbering const &Plan, uint64_t Id) {
+    auto path = Plan.decode(APInt(64, Id));
+    OS << (path.FromBackEdge ? "loop.." : "entry..") << (path.ToBackEdge ? "back" : "exit") << ":";
+    for (auto *B : path.Blocks) OS << " " << ppName(B->getName());
+    OS << "\n";
   }
 
+  /// the number of acyclic paths, then the first or the hottest ones
+  void printPaths(Function &F) {
+    PathNumbering plan(F);
+    SmallString<4096> buffer;
+    raw_svector_ostream OS(buffer);
+    OS << "Func: " << F.getName() << "\n  ";
+    plan.getNumPaths().print(OS, false);
+    OS << " path(s)\n";
+
+    if (PathProfileFile.empty()) {
+      for (uint64_t id = 0; plan.getNumPaths().ugt(id) && id < ListPaths; ++id) {
+        OS << "  path " << id << " ";
+        printPath(OS, plan, id);
+      }
+      errs() << OS.str();
+      return;
+    }
+
+    uint64_t hash = bbprof::functionHash(F.getName());
+    auto checksum = Checksums.find(hash);
+    if (checksum != Checksums.end() && checksum->second != bbprof::cfgChecksum(F)) {
+      OS << "  has a different CFG than the profiled one, skipped\n";
+      errs() << OS.str();
+      return;
+    }
+    auto &counts = PathCounts[hash];
+    llvm::sort(counts, [](std::pair<uint64_t, uint64_t> const &A, std::pair<uint64_t, uint64_t> const &B) {
+      return A.second != B.second ? A.second > B.second : A.first < B.first;
+    });
+    for (unsigned i = 0; i < counts.size() && i < ListPaths; ++i) {
+      OS << "  path " << counts[i].first << " x" << counts[i].second << " ";
+      printPath(OS, plan, counts[i].first);
+    }
+    errs() << OS.str();
+  }
+
+  /// B2 is listed for B1 != B2 iff it is reachable, a block sharing an SCC
+  /// with B1 is on a cycle through it
   void traversePath(Function &F) {
-    errs() << "Func: " << F.getName() << "\n";
-    BBVisitInfo visited;
-    for (auto &B1 : F) {
-      errs() << B1.getName() << ": ";
-      for (auto &B2 : F) {
-        if (&B1 != &B2 && hasPath(&B1, &B2, visited)) {
-          errs() << B2.getName() << " ";
+    ReachabilityIndex &RI = getAnalysis<ReachabilityWrapperPass>().getIndex();
+    ArrayRef<BasicBlock *> blocks = RI.blocks();
+
+    // members of a cycle reach the same blocks, so the list of a cycle is
+    // formatted once, remembering where each member sits in it
+    std::vector<std::string> lists(RI.getNumSCCs());
+    std::vector<size_t> selfAt(blocks.size());
+
+    SmallString<4096> buffer;
+    raw_svector_ostream OS(buffer);
+    OS << "Func: " << F.getName() << "\n";
+    for (unsigned i = 0; i < blocks.size(); ++i) {
+      unsigned c = RI.getSCC(i);
+      OS << blocks[i]->getName() << ": ";
+      if (RI.getSCCSize(c) == 1) {
+        for (unsigned j = 0; j < blocks.size(); ++j) {
+          if (j != i && RI.sccReaches(c, RI.getSCC(j))) OS << blocks[j]->getName() << " ";
         }
+      } else {
+        if (lists[c].empty()) {
+          raw_string_ostream list(lists[c]);
+          for (unsigned j = 0; j < blocks.size(); ++j) {
+            if (!RI.sccReaches(c, RI.getSCC(j))) continue;
+            if (RI.getSCC(j) == c) selfAt[j] = list.tell();
+            list << blocks[j]->getName() << " ";
+          }
+        }
+        StringRef list = lists[c];
+        OS << list.take_front(selfAt[i]) << list.drop_front(selfAt[i] + blocks[i]->getName().size() + 1);
+      }
+      OS << "\n";
+      if (buffer.size() > (1 << 16)) {
+        errs() << buffer;
+        buffer.clear();
       }
-      errs() << "\n";
-      visited.clear();
     }
+    errs() << buffer;
   }
 
   bool runOnFunction(Function &F) override {
-    traversePath(F);
+    if (Mode == PathMode::Paths) {
+      printPaths(F);
+    } else {
+      traversePath(F);
+    }
     return false;
   }
 
@@ -0,0 +1,138 @@
+#include "llvm/IR/Function.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "DefUse.hh"
+
+#include <chrono>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+static cl::opt<unsigned> BenchRounds(
+    "def-use-bench",
+    cl::desc("Instead of printing the chains, time this many rounds of forward "
+             "slices over the CSR index against the same slices over use lists"),
+    cl::init(0));
+}  // namespace
+
+namespace llvm {
+
+/// `opt -load defuse.so -def-use`, prints the users of every value, or
+/// compares the index with the use lists with -def-use-bench
+class DumpDefUse : public FunctionPass {
+ public:
+  static char ID;
+
+  DumpDefUse() : FunctionPass(ID) {}
+
+  void getAnalysisUsage(AnalysisUsage &AU) const override {
+    AU.setPreservesAll();
+    AU.addRequired<DefUseWrapperPass>();
+  }
+
+  static void printValue(raw_ostream &OS, Value const *V) {
+    if (V->hasName() || !V->getType()->isVoidTy()) {
+      V->printAsOperand(OS, false);
+    } else {
+      OS << cast<Instruction>(V)->getOpcodeName();
+    }
+  }
+
+  void printChains(Function &F, DefUseIndex const &DU) {
+    SmallString<4096> buffer;
+    raw_svector_ostream OS(buffer);
+    OS << "Func: " << F.getName() << ", " << DU.size() << " values, " << DU.getNumEdges() << " uses\n";
+    for (unsigned v = 0; v < DU.size(); ++v) {
+      if (DU.users(v).empty()) continue;
+      OS << "  ";
+      printValue(OS, DU.getValue(v));
+      OS << " ->";
+      for (unsigned u : DU.users(v)) {
+        OS << " ";
+        printValue(OS, DU.getValue(u));
+      }
+      OS << "\n";
+      if (buffer.size() > (1 << 16)) {
+        errs() << buffer;
+        buffer.clear();
+      }
+    }
+    errs() << buffer;
+  }
+
+  /// forward slices from the arguments, allocas, loads and calls, what a
+  /// taint or constant propagation starts from
+  void bench(Function &F, DefUseIndex const &DU) {
+    using Clock = std::chrono::steady_clock;
+    std::vector<unsigned> seeds;
+    for (unsigned v = 0; v < DU.size(); ++v) {
+      Value const *V = DU.getValue(v);
+      if (isa<Argument>(V) || isa<AllocaInst>(V) || isa<LoadInst>(V) || isa<CallBase>(V)) seeds.push_back(v);
+    }
+
+    auto start = Clock::now();
+    DefUseIndex rebuilt(F);
+    auto built = Clock::now();
+    size_t csrTotal = 0;
+    BitVector slice;
+    for (unsigned r = 0; r < BenchRounds; ++r) {
+      for (unsigned s : seeds) {
+        slice.reset();
+        rebuilt.forwardSlice(s, slice);
+        csrTotal += slice.count();
+      }
+    }
+    auto csrDone = Clock::now();
+
+    size_t useListTotal = 0;
+    SmallPtrSet<Value const *, 32> visited;
+    std::vector<Value const *> worklist;
+    for (unsigned r = 0; r < BenchRounds; ++r) {
+      for (unsigned s : seeds) {
+        visited.clear();
+        visited.insert(DU.getValue(s));
+        worklist.push_back(DU.getValue(s));
+        while (!worklist.empty()) {
+          Value const *V = worklist.back();
+          worklist.pop_back();
+          for (auto *U : V->users()) {
+            if (isa<Instruction>(U) && visited.insert(U).second) worklist.push_back(U);
+          }
+        }
+        useListTotal += visited.size();
+      }
+    }
+    auto useListDone = Clock::now();
+
+    auto ms = [](Clock::duration D) { return format("%.3f", std::chrono::duration<double, std::milli>(D).count()); };
+    errs() << "Func: " << F.getName() << ", " << DU.size() << " values, " << DU.getNumEdges() << " uses, "
+           << seeds.size() << " seeds x " << BenchRounds << " rounds\n";
+    errs() << "  build " << ms(built - start) << " ms, csr " << ms(csrDone - built) << " ms, use lists "
+           << ms(useListDone - csrDone) << " ms\n";
+    if (csrTotal != useListTotal) errs() << "  slices differ: " << csrTotal << " vs " << useListTotal << "\n";
+  }
+
+  bool runOnFunction(Function &F) override {
+    DefUseIndex &DU = getAnalysis<DefUseWrapperPass>().getIndex();
+    if (BenchRounds) {
+      bench(F, DU);
+    } else {
+      printChains(F, DU);
+    }
+    return false;
+  }
+};
+
+char DumpDefUse::ID = 0;
+static RegisterPass<DumpDefUse> X("def-use", "DumpDefUse", true, true);
+
+}  // namespace llvm
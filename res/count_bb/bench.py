@@ -0,0 +1,102 @@
+#!/usr/bin/python3
+
+# overhead of count-bb -count-bb-strategy=sample against the period, each
+# build compiled as instrumented ("llc") and optimised after instrumentation
+# ("opt -O2"); the sampled build at period 1 must count as plain does
+# usage: bench.py [countbb.so] [c_src or ll] [period...]
+
+import os
+import subprocess
+import sys
+import time
+
+if len(sys.argv) < 3:
+    print("usage: {:s} [countbb.so] [c_src or ll] [period...]".format(sys.argv[0]))
+    exit(1)
+
+plugin = os.path.realpath(sys.argv[1])
+src = sys.argv[2]
+periods = [int(p) for p in sys.argv[3:]] or [1, 10, 100, 1000, 10000]
+runs = 7
+pipelines = [("llc", []), ("opt -O2", ["-O2"])]
+
+ir = "bench-base.ll"
+if src.endswith(".c"):
+    subprocess.check_call(["clang", "-O1", "-emit-llvm", "-S", src, "-o", ir])
+else:
+    ir = src
+
+
+def build(name, opt_args, post_opt):
+    ll = "bench-{:s}.ll".format(name)
+    exe = "bench-{:s}.out".format(name)
+    cmds = [["opt", "-enable-new-pm=0", "-load", plugin] + opt_args + [ir, "-S", "-o", ll]]
+    if post_opt:
+        cmds.append(["opt"] + post_opt + [ll, "-S", "-o", ll])
+    cmds += [
+        ["llc", "-O2", "-relocation-model=pic", "-filetype=obj", ll, "-o", exe + ".o"],
+        ["cc", exe + ".o", "-o", exe],
+    ]
+    for cmd in cmds:
+        subprocess.check_call(cmd)
+    os.remove(ll)
+    os.remove(exe + ".o")
+    return "./" + exe
+
+
+def run_once(exe, env):
+    start = time.perf_counter()
+    subprocess.check_call([exe], env=env, stdout=subprocess.DEVNULL)
+    return time.perf_counter() - start
+
+
+def counts(exe, env):
+    # the profile is printed at exit, every block with its count
+    return subprocess.check_output([exe], env=env, universal_newlines=True)
+
+
+exes = []
+configs = []
+for pipeline, post_opt in pipelines:
+    tag = pipeline.replace(" ", "").replace("-", "")
+    base = build("base-" + tag, [], post_opt)
+    plain = build("plain-" + tag, ["-count-bb"], post_opt)
+    sample = build("sample-" + tag, ["-count-bb", "-count-bb-strategy=sample"], post_opt)
+    exes += [base, plain, sample]
+
+    env = dict(os.environ)
+    env["COUNT_BB_SAMPLE_PERIOD"] = "1"
+    if counts(plain, env) != counts(sample, env):
+        print("{:s}: sample/1 counts differ from plain".format(pipeline))
+        exit(1)
+
+    configs += [(("uninstrumented", pipeline), base, None), (("plain", pipeline), plain, None)]
+    configs += [(("sample/" + str(p), pipeline), sample, p) for p in periods]
+
+# best of the rounds, each round runs every configuration once so that a
+# noisy stretch of the machine hits all of them alike
+best = {}
+for _ in range(runs):
+    for key, exe, period in configs:
+        env = dict(os.environ)
+        if period is not None:
+            env["COUNT_BB_SAMPLE_PERIOD"] = str(period)
+        t = run_once(exe, env)
+        best[key] = min(best.get(key, t), t)
+
+table = {}
+for (name, pipeline), t in best.items():
+    base_time = best[("uninstrumented", pipeline)]
+    table[(name, pipeline)] = (t, None if name == "uninstrumented" else (t / base_time - 1) * 100)
+
+names = ["uninstrumented", "plain"] + ["sample/" + str(p) for p in periods]
+print("{:<16s}".format("config") + "".join(" {:>19s}".format(p) for p, _ in pipelines))
+for name in names:
+    line = "{:<16s}".format(name)
+    for pipeline, _ in pipelines:
+        t, overhead = table[(name, pipeline)]
+        line += " {:8.3f}s {:>9s}".format(t, "-" if overhead is None else "{:.1f}%".format(overhead))
+    print(line)
+
+for exe in exes:
+    os.remove(exe)
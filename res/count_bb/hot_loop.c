@@ -0,0 +1,17 @@
+#include <stdio.h>
+
+/* a branchy loop that keeps count-bb's counters hot */
+long work(long n) {
+  long acc = 0;
+  for (long i = 0; i < n; i++) {
+    if ((i & 3) == 0)
+      acc *= 3;
+    acc += i;
+  }
+  return acc;
+}
+
+int main() {
+  printf("%ld\n", work(300000000));
+  return 0;
+}
@@ -0,0 +1,65 @@
+#!/usr/bin/python3
+
+# ir_dump.out batch mode against one process per file
+# usage: bench.py [ir_dump.out] [directory of .ll/.bc] [jobs...] [-- ir_dump args...]
+
+import concurrent.futures
+import os
+import subprocess
+import sys
+import time
+
+if len(sys.argv) < 3:
+    print("usage: {:s} [ir_dump.out] [directory of .ll/.bc] [jobs...] [-- ir_dump args...]".format(sys.argv[0]))
+    exit(1)
+
+tool = os.path.realpath(sys.argv[1])
+directory = sys.argv[2]
+rest = sys.argv[3:]
+extra = []
+if "--" in rest:
+    extra = rest[rest.index("--") + 1:]
+    rest = rest[:rest.index("--")]
+jobs = [int(j) for j in rest] or [1, os.cpu_count()]
+runs = 3
+
+files = sorted(
+    os.path.join(root, name)
+    for root, _, names in os.walk(directory)
+    for name in names
+    if name.endswith(".ll") or name.endswith(".bc"))
+if not files:
+    print("no .ll/.bc file in {:s}".format(directory))
+    exit(1)
+
+
+def run(args):
+    # a file failing to load is part of the workload, not of the benchmark
+    subprocess.call([tool] + extra + args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+
+def per_process(n):
+    with concurrent.futures.ThreadPoolExecutor(n) as pool:
+        list(pool.map(lambda f: run([f]), files))
+
+
+def batch(n):
+    run(["-j", str(n), directory])
+
+
+def best_of(fn, n):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        fn(n)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+print("{:d} files, best of {:d}".format(len(files), runs))
+print("{:>6s} {:>14s} {:>10s} {:>8s}".format("jobs", "per-process s", "batch s", "speedup"))
+for n in jobs:
+    single = best_of(per_process, n)
+    together = best_of(batch, n)
+    print("{:6d} {:14.3f} {:10.3f} {:7.2f}x".format(n, single, together, single / together))
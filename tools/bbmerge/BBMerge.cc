@@ -0,0 +1,241 @@
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <algorithm>
+#include <map>
+
+#include "BBProfile.hh"
+
+using namespace llvm;
+
+/// sums count-bb binary profiles, `bbmerge.out -j 16 -o all.prof @list`
+static cl::list<std::string> Inputs(cl::Positional, cl::OneOrMore,
+                                    cl::desc("<profile or @file with one profile per line>..."));
+static cl::opt<std::string> OutputFilename("o", cl::desc("Merged profile"), cl::value_desc("filename"),
+                                           cl::init("merged.prof"));
+static cl::opt<unsigned> Jobs("j", cl::desc("Merge threads, 0 for one per core"), cl::init(0));
+
+namespace {
+
+/// what every profile is checked against: the counter mode and the CFG
+/// checksums of the first readable profile in input order, so the merge
+/// does not depend on -j or on how the inputs are split among the workers
+struct Reference {
+  uint32_t Mode = bbprof::k_modeTotal;
+  /// by name hash
+  DenseMap<uint64_t, uint64_t> Checksums;
+};
+
+struct MergedFunction {
+  std::vector<uint64_t> Counters;
+  std::vector<uint64_t> PathCounters;
+  /// indices of the input files that added to it, in input order
+  std::vector<size_t> Files;
+};
+
+struct Accumulator {
+  explicit Accumulator(Reference const &Ref) : Ref(Ref) {}
+
+  Reference const &Ref;
+  /// by name hash and CFG checksum. A function the reference does not have
+  /// may come with several checksums, the one of the earliest file wins
+  /// once the workers are merged
+  std::map<std::pair<uint64_t, uint64_t>, MergedFunction> Functions;
+  /// the single counter of total-mode profiles
+  uint64_t Total = 0;
+  uint64_t NumProfiles = 0;
+  std::vector<std::string> Warnings;
+
+  static void sum(std::vector<uint64_t> &Dst, ArrayRef<uint64_t> Src) {
+    if (Dst.size() < Src.size()) Dst.resize(Src.size());
+    for (size_t i = 0; i < Src.size(); ++i) Dst[i] = SaturatingAdd(Dst[i], Src[i]);
+  }
+
+  static std::string mismatch(StringRef From, uint64_t NameHash) {
+    return (From + ": CFG checksum mismatch for function " + utohexstr(NameHash) + ", skipped").str();
+  }
+
+  void addFunction(uint64_t NameHash, uint64_t Checksum, ArrayRef<uint64_t> Counters,
+                   ArrayRef<uint64_t> PathCounters, size_t File, StringRef From) {
+    auto ref = Ref.Checksums.find(NameHash);
+    if (ref != Ref.Checksums.end() && ref->second != Checksum) {
+      Warnings.push_back(mismatch(From, NameHash));
+      return;
+    }
+    auto &entry = Functions[{NameHash, Checksum}];
+    sum(entry.Counters, Counters);
+    sum(entry.PathCounters, PathCounters);
+    entry.Files.push_back(File);
+  }
+
+  void add(bbprof::ProfileView const &P, size_t File, StringRef From) {
+    if (P.H->Mode != Ref.Mode) {
+      Warnings.push_back((From + ": counter mode differs from the other profiles, skipped").str());
+      return;
+    }
+    ++NumProfiles;
+    if (P.H->Mode == bbprof::k_modeTotal && !P.Counters.empty()) Total = SaturatingAdd(Total, P.Counters.front());
+    for (auto const &R : P.Functions)
+      addFunction(R.NameHash, R.CFGChecksum, P.countersOf(R), P.pathCountersOf(R), File, From);
+  }
+
+  /// Other merged the files after those of this accumulator
+  void add(Accumulator &Other) {
+    Warnings.insert(Warnings.end(), Other.Warnings.begin(), Other.Warnings.end());
+    NumProfiles += Other.NumProfiles;
+    Total = SaturatingAdd(Total, Other.Total);
+    for (auto &F : Other.Functions) {
+      auto &entry = Functions[F.first];
+      sum(entry.Counters, F.second.Counters);
+      sum(entry.PathCounters, F.second.PathCounters);
+      entry.Files.insert(entry.Files.end(), F.second.Files.begin(), F.second.Files.end());
+    }
+  }
+
+  /// keeps one checksum per function, the one of the earliest file, and
+  /// reports the files of the others as a sequential merge would have
+  void resolveChecksums(ArrayRef<std::string> Files) {
+    for (auto it = Functions.begin(); it != Functions.end();) {
+      auto last = std::next(it);
+      while (last != Functions.end() && last->first.first == it->first.first) ++last;
+      auto winner = std::min_element(it, last, [](auto const &A, auto const &B) {
+        return A.second.Files.front() < B.second.Files.front();
+      });
+      for (auto other = it; other != last;) {
+        if (other == winner) {
+          ++other;
+          continue;
+        }
+        for (size_t file : other->second.Files) Warnings.push_back(mismatch(Files[file], other->first.first));
+        other = Functions.erase(other);
+      }
+      it = last;
+    }
+  }
+};
+
+/// reads one profile, Warn gets the reason if it cannot be
+template <typename WarnFn>
+Optional<bbprof::ProfileView> openProfile(std::string const &File, std::unique_ptr<MemoryBuffer> &Buffer,
+                                          WarnFn Warn) {
+  // MemoryBuffer mmaps large files, the counters are summed in place
+  auto buffer = MemoryBuffer::getFile(File, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+  if (!buffer) {
+    Warn(File + ": " + buffer.getError().message());
+    return None;
+  }
+  Buffer = std::move(buffer.get());
+  auto profile = bbprof::readProfile(Buffer->getBuffer());
+  if (!profile) {
+    Warn(File + ": " + toString(profile.takeError()));
+    return None;
+  }
+  return *profile;
+}
+
+/// the reference of the first readable profile, false if there is none
+bool readReference(ArrayRef<std::string> Files, Reference &Ref) {
+  for (auto const &file : Files) {
+    std::unique_ptr<MemoryBuffer> buffer;
+    // the workers read it again and report it
+    auto profile = openProfile(file, buffer, [](std::string const &) {});
+    if (!profile) continue;
+    Ref.Mode = profile->H->Mode;
+    for (auto const &R : profile->Functions) Ref.Checksums.try_emplace(R.NameHash, R.CFGChecksum);
+    return true;
+  }
+  return false;
+}
+
+/// Files[i] is input file FirstFile + i
+void mergeFiles(ArrayRef<std::string> Files, size_t FirstFile, Accumulator &Acc) {
+  for (size_t i = 0; i < Files.size(); ++i) {
+    std::unique_ptr<MemoryBuffer> buffer;
+    auto profile = openProfile(Files[i], buffer, [&](std::string Warning) { Acc.Warnings.push_back(Warning); });
+    if (profile) Acc.add(*profile, FirstFile + i, Files[i]);
+  }
+}
+
+void expandInputs(std::vector<std::string> &Files) {
+  for (auto const &input : Inputs) {
+    if (!StringRef(input).startswith("@")) {
+      Files.push_back(input);
+      continue;
+    }
+    auto list = MemoryBuffer::getFile(input.substr(1), /*IsText=*/true);
+    if (!list) {
+      errs() << input.substr(1) << ": " << list.getError().message() << "\n";
+      std::exit(1);
+    }
+    SmallVector<StringRef, 64> lines;
+    list.get()->getBuffer().split(lines, '\n', -1, false);
+    for (auto line : lines) {
+      if (!line.trim().empty()) Files.push_back(line.trim().str());
+    }
+  }
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv, "count-bb profile merger\n");
+
+  std::vector<std::string> files;
+  expandInputs(files);
+
+  Reference ref;
+  bool haveRef = readReference(files, ref);
+
+  // contiguous chunks of the file list, one accumulator per worker
+  unsigned numWorkers = std::max<size_t>(1, std::min<size_t>(files.size(), Jobs ? Jobs
+                                                                                 : hardware_concurrency().compute_thread_count()));
+  std::vector<Accumulator> accs(numWorkers, Accumulator(ref));
+  {
+    ThreadPool pool(hardware_concurrency(numWorkers));
+    size_t chunk = divideCeil(files.size(), numWorkers);
+    for (unsigned i = 0; i < numWorkers; ++i) {
+      size_t first = std::min(files.size(), i * chunk);
+      ArrayRef<std::string> slice = makeArrayRef(files).drop_front(first).take_front(chunk);
+      pool.async([slice, first, &accs, i] { mergeFiles(slice, first, accs[i]); });
+    }
+    pool.wait();
+  }
+  Accumulator &merged = accs.front();
+  for (unsigned i = 1; i < numWorkers; ++i) merged.add(accs[i]);
+  merged.resolveChecksums(files);
+  for (auto const &warning : merged.Warnings) errs() << "warning: " << warning << "\n";
+  if (!haveRef || merged.NumProfiles == 0) {
+    errs() << "no profile merged\n";
+    std::exit(1);
+  }
+
+  // functions by name hash, so the output does not depend on the input order
+  std::vector<bbprof::FunctionRecord> records;
+  // the total of a total-mode profile is its first counter
+  std::vector<uint64_t> counters;
+  if (ref.Mode == bbprof::k_modeTotal) counters.push_back(merged.Total);
+  for (auto &F : merged.Functions) {
+    auto &entry = F.second;
+    uint64_t base = counters.size();
+    counters.insert(counters.end(), entry.Counters.begin(), entry.Counters.end());
+    records.push_back({F.first.first, F.first.second, base, entry.Counters.size(), counters.size(),
+                       entry.PathCounters.size()});
+    counters.insert(counters.end(), entry.PathCounters.begin(), entry.PathCounters.end());
+  }
+
+  std::error_code EC;
+  raw_fd_ostream OS(OutputFilename, EC, sys::fs::OF_None);
+  if (EC) {
+    errs() << OutputFilename << ": " << EC.message() << "\n";
+    std::exit(1);
+  }
+  bbprof::writeProfile(OS, ref.Mode, records, counters);
+  errs() << "merged " << merged.NumProfiles << " of " << files.size() << " profile(s) into " << OutputFilename
+         << "\n";
+  return 0;
+}
@@ -0,0 +1,124 @@
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "BBProfile.hh"
+#include "EdgeProfile.hh"
+#include "LLDump.hh"
+
+using namespace llvm;
+
+/// rebuilds block and edge counts from the text dump (edge mode) or the
+/// binary profile of a module instrumented with `opt -count-bb`
+namespace {
+
+/// "<function> <slot> <count>" lines, anything else is ignored
+StringMap<std::vector<uint64_t>> readCounterDump(StringRef Dump) {
+  StringMap<std::vector<uint64_t>> counters;
+  SmallVector<StringRef, 3> fields;
+  while (!Dump.empty()) {
+    StringRef line;
+    std::tie(line, Dump) = Dump.split('\n');
+    fields.clear();
+    line.split(fields, ' ', -1, false);
+    uint64_t slot, count;
+    if (fields.size() != 3 || fields[1].getAsInteger(10, slot) || fields[2].getAsInteger(10, count))
+      continue;
+    auto &slots = counters[fields[0]];
+    if (slots.size() <= slot) slots.resize(slot + 1);
+    slots[slot] = count;
+  }
+  return counters;
+}
+
+uint64_t printFunction(Function &F, ArrayRef<uint64_t> Counters, bool EdgeMode) {
+  DenseMap<BasicBlock const *, unsigned> index;
+  for (auto &B : F) index[&B] = index.size();
+
+  errs() << "Func: " << F.getName() << "\n";
+  EdgeProfilePlan plan(F);
+  DenseMap<BasicBlock const *, uint64_t> blockCounts;
+  if (!EdgeMode || !plan.isValid()) {
+    // block mode, or count-bb fell back to one counter per block
+    for (auto &B : F) {
+      unsigned i = index[&B];
+      blockCounts[&B] = i < Counters.size() ? Counters[i] : 0;
+    }
+  } else {
+    std::vector<uint64_t> edgeCounts;
+    plan.reconstruct(Counters, edgeCounts, blockCounts);
+    for (unsigned i = 0; i < edgeCounts.size(); ++i) {
+      auto const &E = plan.edges()[i];
+      if (!E.Src || !E.Dst) continue;
+      errs() << "  edge " << index[E.Src] << " -> " << index[E.Dst] << ": " << edgeCounts[i] << "\n";
+    }
+  }
+
+  uint64_t total = 0;
+  for (auto &B : F) {
+    errs() << "  BB " << index[&B] << " " << ppName(B.getName()) << ": " << blockCounts[&B] << "\n";
+    total += blockCounts[&B];
+  }
+  return total;
+}
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    errs() << "Usage: " << argv[0] << " <uninstrumented IR file> <count-bb output or profile>\n";
+    std::exit(1);
+  }
+
+  SMDiagnostic Err;
+  LLVMContext ctx;
+  std::unique_ptr<Module> Mod(parseIRFile(argv[1], Err, ctx));
+  if (!Mod) {
+    Err.print(argv[0], errs());
+    std::exit(1);
+  }
+
+  auto dump = MemoryBuffer::getFile(argv[2]);
+  if (!dump) {
+    errs() << argv[2] << ": " << dump.getError().message() << "\n";
+    std::exit(1);
+  }
+  StringRef buffer = dump.get()->getBuffer();
+
+  uint64_t total = 0;
+  if (buffer.size() >= sizeof(uint64_t) && *reinterpret_cast<uint64_t const *>(buffer.data()) == bbprof::k_magic) {
+    auto profile = bbprof::readProfile(buffer);
+    if (!profile) {
+      logAllUnhandledErrors(profile.takeError(), errs(), StringRef(argv[2]) + ": ");
+      std::exit(1);
+    }
+    if (profile->H->Mode == bbprof::k_modeTotal) {
+      errs() << (profile->Counters.empty() ? 0 : profile->Counters.front()) << " BB(s) Executed\n";
+      return 0;
+    }
+    DenseMap<uint64_t, bbprof::FunctionRecord const *> records;
+    for (auto const &R : profile->Functions) records[R.NameHash] = &R;
+    for (auto &F : *Mod) {
+      auto it = records.find(bbprof::functionHash(F.getName()));
+      if (F.isDeclaration() || it == records.end()) continue;
+      if (it->second->CFGChecksum != bbprof::cfgChecksum(F)) {
+        errs() << "Func: " << F.getName() << " has a different CFG than the profiled one, skipped\n";
+        continue;
+      }
+      total += printFunction(F, profile->countersOf(*it->second), profile->H->Mode == bbprof::k_modeEdge);
+    }
+  } else {
+    auto counters = readCounterDump(buffer);
+    for (auto &F : *Mod) {
+      auto it = counters.find(F.getName());
+      if (F.isDeclaration() || it == counters.end()) continue;
+      total += printFunction(F, it->second, true);
+    }
+  }
+  errs() << total << " BB(s) Executed\n";
+  return 0;
+}
@@ -1,215 +1,942 @@
 #include <llvm/IR/IntrinsicInst.h>
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
 #include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/ModuleSlotTracker.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/Pass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Regex.h"
 #include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "llvm/IR/CFG.h"
 
+#include <atomic>
+#include <mutex>
+
 #include "LLDump.hh"
 #include "LLUtils.hh"
+#include "LoopCost.hh"
+#include "LoopNest.hh"
+#include "TypeLayout.hh"
 
 using namespace llvm;
 
+static cl::list<std::string> InputFilenames(cl::Positional, cl::ZeroOrMore, cl::desc("<IR file or directory>..."));
+static cl::opt<std::string> FilesFrom("files-from", cl::desc("Also dump the IR files listed in this file, one per line"),
+                                      cl::value_desc("filename"));
+static cl::opt<unsigned> Jobs("j", cl::desc("Threads dumping functions, or files in batch mode, 0 for one per core"),
+                              cl::init(1));
+static cl::opt<std::string> FunctionFilter(
+    "function", cl::desc("Only dump the functions whose name matches, the other bodies are not even loaded"),
+    cl::value_desc("regex"));
+static cl::opt<bool> GlobalsOnly("globals-only",
+                                 cl::desc("Dump function headers and globals but load no function body"),
+                                 cl::init(false));
+static cl::opt<bool> Loops("loops",
+                           cl::desc("Report the loop nests with their SCEV trip counts instead of the bodies"),
+                           cl::init(false));
+static cl::opt<unsigned> HotLoops(
+    "hot-loops",
+    cl::desc("Rank the loops of all the inputs by their static cost and print the N hottest, see LoopCost"),
+    cl::value_desc("N"), cl::init(0));
+
+enum class DumpFormat { Text, Jsonl };
+
+static cl::opt<DumpFormat> Format(
+    "format", cl::desc("Dump format"), cl::init(DumpFormat::Text),
+    cl::values(clEnumValN(DumpFormat::Text, "text", "colored text on stderr"),
+               clEnumValN(DumpFormat::Jsonl, "jsonl", "one JSON record per line, see JsonlWriter")));
+static cl::opt<std::string> OutputFilename("o", cl::desc("Output of --format=jsonl"), cl::value_desc("filename"),
+                                           cl::init("-"));
+static cl::opt<std::string> CacheDir(
+    "cache-dir", cl::desc("Keep the dumps here, keyed by the MD5 of the IR file; unchanged files are not parsed again"),
+    cl::value_desc("directory"));
+
+/// files loaded and dumped at once in batch mode, per thread
+static size_t const k_filesPerThread = 4;
+
+/// functions dumped back to back by one task of -j
+static size_t const k_fnsPerTask = 16;
+
+/// --format=jsonl, one record per line, "rec" tells the kind:
+///
+///   {"rec":"module","name","triple","datalayout"}
+///   {"rec":"global","name","type","linkage","constant","size_bits"}
+///   {"rec":"function","name","type","linkage","declaration","args","blocks"}
+///   {"rec":"block","fn","id","name","preds":[id],"succs":[id]}
+///   {"rec":"inst","fn","bb","id","opcode","type","name","ops":[op]}
+///   {"rec":"loop",...}  (--loops, in place of the above, see LoopNestReport)
+///   {"rec":"hot_loop",...}  (--hot-loops, after all the inputs, see LoopCost)
+///   {"rec":"error","file","message"}  (batch mode, a file failed to load)
+///
+/// Blocks and instructions are numbered from 0 in function order. An
+/// operand is one of {"inst":id}, {"arg":no}, {"block":id},
+/// {"global":name}, {"int":value,"type"} or {"const":kind,"type"}. Allocas
+/// add "alloca_type" and "alloca_bits" from the DataLayout, direct calls
+/// add "callee". Empty names are left out.
+struct JsonlWriter {
+  explicit JsonlWriter(DataLayout const &DL) : Layouts(DL) {}
+
+  TypeLayoutCache Layouts;
+  /// printing a type walks it, the few distinct types are printed once
+  DenseMap<Type *, std::string> TypeNames;
+  DenseMap<Value const *, unsigned> Ids;
+
+  StringRef typeName(Type *T) {
+    auto &name = TypeNames[T];
+    if (name.empty()) {
+      raw_string_ostream OS(name);
+      T->print(OS, false, true);
+    }
+    return name;
+  }
+
+  static StringRef linkageName(GlobalValue const &GV) {
+    switch (GV.getLinkage()) {
+      case GlobalValue::ExternalLinkage: return "external";
+      case GlobalValue::AvailableExternallyLinkage: return "available_externally";
+      case GlobalValue::LinkOnceAnyLinkage: return "linkonce";
+      case GlobalValue::LinkOnceODRLinkage: return "linkonce_odr";
+      case GlobalValue::WeakAnyLinkage: return "weak";
+      case GlobalValue::WeakODRLinkage: return "weak_odr";
+      case GlobalValue::AppendingLinkage: return "appending";
+      case GlobalValue::InternalLinkage: return "internal";
+      case GlobalValue::PrivateLinkage: return "private";
+      case GlobalValue::ExternalWeakLinkage: return "extern_weak";
+      case GlobalValue::CommonLinkage: return "common";
+    }
+    return "unknown";
+  }
+
+  void writeModule(Module &M, raw_ostream &OS) {
+    json::OStream J(OS);
+    J.object([&] {
+      J.attribute("rec", "module");
+      J.attribute("name", M.getModuleIdentifier());
+      J.attribute("triple", M.getTargetTriple());
+      J.attribute("datalayout", M.getDataLayoutStr());
+    });
+    OS << "\n";
+  }
+
+  void writeGlobals(Module &M, raw_ostream &OS) {
+    for (auto &GV : M.globals()) {
+      json::OStream J(OS);
+      J.object([&] {
+        J.attribute("rec", "global");
+        J.attribute("name", GV.getName());
+        J.attribute("type", typeName(GV.getValueType()));
+        J.attribute("linkage", linkageName(GV));
+        J.attribute("constant", GV.isConstant());
+        auto &L = Layouts.get(GV.getValueType());
+        if (L.Sized) J.attribute("size_bits", L.AllocSize * 8);
+      });
+      OS << "\n";
+    }
+  }
+
+  void writeOperand(json::OStream &J, Value const *V) {
+    J.object([&] {
+      if (isa<Instruction>(V) || isa<BasicBlock>(V)) {
+        J.attribute(isa<BasicBlock>(V) ? "block" : "inst", Ids.lookup(V));
+      } else if (auto *A = dyn_cast<Argument>(V)) {
+        J.attribute("arg", A->getArgNo());
+      } else if (auto *GV = dyn_cast<GlobalValue>(V)) {
+        J.attribute("global", GV->getName());
+      } else if (auto *CI = dyn_cast<ConstantInt>(V)) {
+        if (CI->getBitWidth() <= 64) {
+          J.attribute("int", CI->getSExtValue());
+        } else {
+          J.attribute("int", toString(CI->getValue(), 10, true));
+        }
+        J.attribute("type", typeName(V->getType()));
+      } else {
+        J.attribute("const", getValueKindStr(V));
+        J.attribute("type", typeName(V->getType()));
+      }
+    });
+  }
+
+  static StringRef getValueKindStr(Value const *V) {
+    if (isa<ConstantPointerNull>(V)) return "null";
+    if (isa<UndefValue>(V)) return isa<PoisonValue>(V) ? "poison" : "undef";
+    if (isa<ConstantFP>(V)) return "fp";
+    if (isa<ConstantExpr>(V)) return "expr";
+    if (isa<ConstantAggregateZero>(V)) return "zeroinitializer";
+    if (isa<ConstantData>(V) || isa<ConstantAggregate>(V)) return "aggregate";
+    if (isa<InlineAsm>(V)) return "asm";
+    if (isa<MetadataAsValue>(V)) return "metadata";
+    return "other";
+  }
+
+  void writeFunction(Function &F, raw_ostream &OS) {
+    {
+      json::OStream J(OS);
+      J.object([&] {
+        J.attribute("rec", "function");
+        J.attribute("name", F.getName());
+        J.attribute("type", typeName(F.getFunctionType()));
+        J.attribute("linkage", linkageName(F));
+        J.attribute("declaration", F.isDeclaration());
+        J.attribute("args", F.arg_size());
+        J.attribute("blocks", F.size());
+      });
+      OS << "\n";
+    }
+    if (GlobalsOnly) return;
+
+    Ids.clear();
+    unsigned numBlocks = 0, numInsts = 0;
+    for (auto &B : F) {
+      Ids[&B] = numBlocks++;
+      for (auto &I : B) Ids[&I] = numInsts++;
+    }
+    for (auto &B : F) {
+      json::OStream J(OS);
+      J.object([&] {
+        J.attribute("rec", "block");
+        J.attribute("fn", F.getName());
+        J.attribute("id", Ids.lookup(&B));
+        if (B.hasName()) J.attribute("name", B.getName());
+        J.attributeArray("preds", [&] {
+          for (auto *P : predecessors(&B)) J.value(Ids.lookup(P));
+        });
+        J.attributeArray("succs", [&] {
+          for (auto *S : successors(&B)) J.value(Ids.lookup(S));
+        });
+      });
+      OS << "\n";
+      for (auto &I : B) writeInst(I, F.getName(), Ids.lookup(&B), OS);
+    }
+  }
+
+  void writeInst(Instruction &I, StringRef Fn, unsigned Block, raw_ostream &OS) {
+    json::OStream J(OS);
+    J.object([&] {
+      J.attribute("rec", "inst");
+      J.attribute("fn", Fn);
+      J.attribute("bb", Block);
+      J.attribute("id", Ids.lookup(&I));
+      J.attribute("opcode", I.getOpcodeName());
+      J.attribute("type", typeName(I.getType()));
+      if (I.hasName()) J.attribute("name", I.getName());
+      J.attributeArray("ops", [&] {
+        for (auto &op : I.operands()) writeOperand(J, op.get());
+      });
+      if (auto *AI = dyn_cast<AllocaInst>(&I)) {
+        J.attribute("alloca_type", typeName(AI->getAllocatedType()));
+        auto *count = dyn_cast<ConstantInt>(AI->getArraySize());
+        if (count) J.attribute("alloca_bits", Layouts.getAllocSize(AI->getAllocatedType()) * 8 * count->getZExtValue());
+      } else if (auto *CB = dyn_cast<CallBase>(&I)) {
+        if (auto *callee = CB->getCalledFunction()) J.attribute("callee", callee->getName());
+      }
+    });
+    OS << "\n";
+  }
+};
+
+/// --hot-loops: the loops of every module, ranked once all are reported;
+/// each module's are cut down to the N hottest as they come, so a batch of
+/// thousands of files holds no more than twice N
+class HotLoopRanking {
+ public:
+  explicit HotLoopRanking(size_t N) : N(N) {}
+
+  void add(std::vector<HotLoop> Loops) {
+    rankHotLoops(Loops, N);
+    std::lock_guard<std::mutex> lock(Lock);
+    Ranked.insert(Ranked.end(), std::make_move_iterator(Loops.begin()), std::make_move_iterator(Loops.end()));
+    if (Ranked.size() > 2 * N) rankHotLoops(Ranked, N);
+  }
+
+  void print(raw_ostream &OS) {
+    rankHotLoops(Ranked, N);
+    printHotLoops(OS, Ranked, Format == DumpFormat::Jsonl);
+  }
+
+ private:
+  size_t N;
+  std::mutex Lock;
+  std::vector<HotLoop> Ranked;
+};
+
 struct DumpModulePass : public ModulePass {
   static char ID;
 
-  DumpModulePass() : ModulePass(ID) {}
+  /// Filter, if any, selects the functions to dump; the dump goes to Out
+  /// on NumThreads threads; with Hot, the loops go to the ranking instead
+  DumpModulePass(Regex const *Filter, raw_ostream &Out, unsigned NumThreads, HotLoopRanking *Hot = nullptr)
+      : ModulePass(ID), Filter(Filter), Out(Out), NumThreads(NumThreads), Hot(Hot) {}
+
+  Regex const *Filter;
+  raw_ostream &Out;
+  unsigned NumThreads;
+  HotLoopRanking *Hot;
 
   void getAnalysisUsage(AnalysisUsage &AU) const override {}
 
-  void printInstArgType(Instruction &I) {
-    errs() << "\nInstruction: " << I << "\n";
+  void printInstArgType(Instruction &I, raw_ostream &OS) {
+    OS << "\nInstruction: " << I << "\n";
     Type *instTy = I.getType();
     if (instTy->isPointerTy()) {
-      errs() << "POINT ";
+      OS << "POINT ";
       instTy = dyn_cast<PointerType>(instTy)->getNonOpaquePointerElementType();
     }
     getTypeStr(instTy);
     for (auto &arg : I.operands()) {
       Type *ty = arg->getType();
       if (ty->isPointerTy()) {
-        errs() << "POINT ";
+        OS << "POINT ";
         ty = dyn_cast<PointerType>(ty)->getNonOpaquePointerElementType();
       }
       getTypeStr(ty);
     }
   }
 
-  bool runOnBasicBlock(BasicBlock &B, DataLayout const &dataLayout) {
-    WITH_COLOR(raw_ostream::CYAN,
-               errs() << "---> BB (in " << B.getParent()->getName()
+  bool runOnBasicBlock(BasicBlock &B, TypeLayoutCache &Layouts, ModuleSlotTracker &MST, raw_ostream &OS) {
+    WITH_COLOR_OS(OS, raw_ostream::CYAN,
+               OS << "---> BB (in " << B.getParent()->getName()
                       << "): " << ppName(B.getName()) << "\n";);
     for (auto &inst : B) {
-      errs() << "INST: " << inst << "\n";
+      OS << "INST: ";
+      inst.print(OS, MST);
+      OS << "\n";
       if (auto *allocaInst = dyn_cast<AllocaInst>(&inst)) {
         auto *allocType = allocaInst->getAllocatedType();
-        errs() << "AllocaInst type: " << ToString(allocType)
-               << " allocSize=" << dataLayout.getTypeSizeInBits(allocType)
+        OS << "AllocaInst type: " << ToString(allocType)
+               << " allocSize=" << Layouts.getSizeInBits(allocType)
                << " bits\n";
       } else if (auto *gep = dyn_cast<GetElementPtrInst>(&inst)) {
-        errs() << getValueStr(gep) << " type: " << ToString(gep->getType())
-               << "\n";
-        errs() << "  pointer operand: " << ToString(gep->getPointerOperand())
+        OS << getValueStr(gep) << " type: " << ToString(gep->getType())
                << "\n";
-        errs() << "  Indices: ";
+        OS << "  pointer operand: ";
+        gep->getPointerOperand()->print(OS, MST);
+        OS << "\n";
+        OS << "  Indices: ";
         for (auto Idx = gep->idx_begin(), IdxE = gep->idx_end(); Idx != IdxE;
              ++Idx) {
-          errs() << "[" << ToString(Idx->get()) << "] ";
+          OS << "[";
+          Idx->get()->print(OS, MST);
+          OS << "] ";
         }
-        errs() << "\n";
+        OS << "\n";
+        if (auto offset = Layouts.getGEPOffset(cast<GEPOperator>(*gep))) OS << "  byte offset: " << *offset << "\n";
       } else if (auto *phi = dyn_cast<PHINode>(&inst)) {
-        _dump_PHINode(phi);
+        _dump_PHINode(phi, OS);
       } else if (auto *CI = dyn_cast<CallInst>(&inst)) {
-        _dump_CallInst(CI);
+        _dump_CallInst(CI, OS);
       }
     }
     return false;
   }
 
-  void _dump_CallInst(CallInst *callInst) {
+  void _dump_CallInst(CallInst *callInst, raw_ostream &OS) {
     Value *calledValue = callInst->getCalledFunction();
     if (auto *ia = dyn_cast<InlineAsm>(calledValue)) {
-      _dump_InlineASM(ia);
+      _dump_InlineASM(ia, OS);
     }
     Function *callee = callInst->getCalledFunction();
     if (callee != nullptr) {
-      errs() << "callee: " << callee->getName() << "\t";
+      OS << "callee: " << callee->getName() << "\t";
       if (auto *ii = dyn_cast<IntrinsicInst>(callInst)) {
         if (auto *cfpi = dyn_cast<ConstrainedFPIntrinsic>(ii)) {
-          errs() << "constrainedFPIntrinsic"
+          OS << "constrainedFPIntrinsic"
                  << "\n";
         } else if (auto *dbgii = dyn_cast<DbgInfoIntrinsic>(ii)) {
-          errs() << "DbgInfo\n";
+          OS << "DbgInfo\n";
         } else if (auto *vci = dyn_cast<VACopyInst>(ii)) {
-          errs() << "va_copy\n";
+          OS << "va_copy\n";
         } else if (auto *vei = dyn_cast<VAEndInst>(ii)) {
-          errs() << "va_end\n";
+          OS << "va_end\n";
         } else if (auto *vsi = dyn_cast<VAStartInst>(ii)) {
-          errs() << "va_start\n";
+          OS << "va_start\n";
         } else if (auto *memset = dyn_cast<MemSetInst>(ii)) {
-          errs() << "memset\n";
+          OS << "memset\n";
         } else if (auto *memcpy = dyn_cast<MemCpyInst>(ii)) {
-          errs() << "memcpy\n";
+          OS << "memcpy\n";
         } else if (auto *memmove = dyn_cast<MemMoveInst>(ii)) {
-          errs() << "memmove\n";
+          OS << "memmove\n";
         } else if (auto *atomic_memcpy = dyn_cast<AtomicMemCpyInst>(ii)) {
-          errs() << "automic_memcpy\n";
+          OS << "automic_memcpy\n";
         } else if (auto *atomic_memmove = dyn_cast<AtomicMemMoveInst>(ii)) {
-          errs() << "automic_memmove\n";
+          OS << "automic_memmove\n";
         } else if (auto *any_memcpy = dyn_cast<AnyMemCpyInst>(ii)) {
-          errs() << "any_memcpy\n";
+          OS << "any_memcpy\n";
         } else if (auto *any_memmove = dyn_cast<AnyMemMoveInst>(ii)) {
-          errs() << "any_memmove\n";
+          OS << "any_memmove\n";
         } else {
-          errs() << "Untracked IntrinsicInst\n";
+          OS << "Untracked IntrinsicInst\n";
         }
       } else {
-        errs() << "\n";
+        OS << "\n";
       }
     }
   }
 
-  void _dump_InlineASM(InlineAsm *ia) {
-    errs() << "\ninline asm: " << *ia << "\n";
-    errs() << "asm string: ";
-    errs().write_escaped(ia->getAsmString());
-    errs() << "\nconstraint string: " << ia->getConstraintString() << "\n";
-    errs() << "hasSideEffects: " << ia->hasSideEffects() << "\n";
-    errs() << "isAlignStack: " << ia->isAlignStack() << "\n";
-    errs() << "dialect: "
+  void _dump_InlineASM(InlineAsm *ia, raw_ostream &OS) {
+    OS << "\ninline asm: " << *ia << "\n";
+    OS << "asm string: ";
+    OS.write_escaped(ia->getAsmString());
+    OS << "\nconstraint string: " << ia->getConstraintString() << "\n";
+    OS << "hasSideEffects: " << ia->hasSideEffects() << "\n";
+    OS << "isAlignStack: " << ia->isAlignStack() << "\n";
+    OS << "dialect: "
            << (ia->getDialect() == InlineAsm::AD_ATT ? "att" : "intel") << "\n";
-    errs() << "Type: " << ia->getType();
-    errs() << "\n";
-    errs() << "split asm string...\n";
+    OS << "Type: " << ia->getType();
+    OS << "\n";
+    OS << "split asm string...\n";
     SmallVector<StringRef, 4> asmPieces;
   }
 
-  void _dumpFnTy(Function &F) {
+  void _dumpFnTy(Function &F, raw_ostream &OS) {
     FunctionType *fnTy = F.getFunctionType();
     getTypeStr(fnTy);
     Type *retTy = fnTy->getReturnType();
-    errs() << " retType: ";
+    OS << " retType: ";
     getTypeStr(retTy);
-    errs() << "ParameterTypes (" << fnTy->getNumParams() << "):\n";
+    OS << "ParameterTypes (" << fnTy->getNumParams() << "):\n";
     unsigned i = 0;
     for (auto *ty : fnTy->params()) {
       i++;
-      errs() << " " << i << ") ";
+      OS << " " << i << ") ";
       getTypeStr(ty);
     }
   }
 
-  void _dump_PHINode(PHINode *phi) {
-    errs() << getValueStr(phi) << " incoming: " << phi->getNumIncomingValues()
+  void _dump_PHINode(PHINode *phi, raw_ostream &OS) {
+    OS << getValueStr(phi) << " incoming: " << phi->getNumIncomingValues()
            << "\n";
     BasicBlock *B = phi->getParent();
     for (auto pred = pred_begin(B); pred != pred_end(B); ++pred) {
       BasicBlock *predBB = *pred;
       int index = phi->getBasicBlockIndex(predBB);
-      errs() << "\tindex of " << predBB->getName() << " is " << index << "\n";
+      OS << "\tindex of " << predBB->getName() << " is " << index << "\n";
     }
   }
 
-  // global values
-  void printGlobalValues(Module &M) {
-    WITH_COLOR(raw_ostream::RED, errs() << "\n===> global variables:";);
-    WITH_COLOR(raw_ostream::RED, errs() << "\n===> global alias:";);
-    WITH_COLOR(raw_ostream::RED, errs() << "\n===> ifuncs:";);
+  // global values, one line each, as the jsonl global records
+  void printGlobalValues(Module &M, raw_ostream &OS) {
+    TypeLayoutCache Layouts(M.getDataLayout());
+    WITH_COLOR_OS(OS, raw_ostream::RED, OS << "\n===> global variables:";);
+    for (auto &GV : M.globals()) {
+      OS << "\n  ";
+      GV.printAsOperand(OS, false);
+      OS << ": ";
+      GV.getValueType()->print(OS, false, true);
+      OS << ", " << JsonlWriter::linkageName(GV);
+      if (GV.isConstant()) OS << ", constant";
+      auto &L = Layouts.get(GV.getValueType());
+      if (L.Sized) OS << ", " << L.AllocSize << " bytes";
+      if (GV.hasInitializer()) {
+        OS << ", init ";
+        GV.getInitializer()->printAsOperand(OS, false, &M);
+      }
+    }
+    WITH_COLOR_OS(OS, raw_ostream::RED, OS << "\n===> global alias:";);
+    for (auto &GA : M.aliases()) {
+      OS << "\n  ";
+      GA.printAsOperand(OS, false);
+      OS << ": " << JsonlWriter::linkageName(GA) << ", aliasee ";
+      GA.getAliasee()->printAsOperand(OS, false, &M);
+    }
+    WITH_COLOR_OS(OS, raw_ostream::RED, OS << "\n===> ifuncs:";);
+    for (auto &GI : M.ifuncs()) {
+      OS << "\n  ";
+      GI.printAsOperand(OS, false);
+      OS << ": " << JsonlWriter::linkageName(GI) << ", resolver ";
+      GI.getResolver()->printAsOperand(OS, false, &M);
+    }
   }
 
-  void printNMetadata(Module &M) {
-    WITH_COLOR(raw_ostream::MAGENTA, errs() << "\n===> NMetadate:";);
+  void printNMetadata(Module &M, raw_ostream &OS) {
+    WITH_COLOR_OS(OS, raw_ostream::MAGENTA, OS << "\n===> NMetadate:";);
   }
 
-  bool runOnFunc(Function &F, DataLayout const &layout) {
-    WITH_COLOR(raw_ostream::RED,
-               errs() << "\n===> FUNC: " << F.getName() << "\n";);
-    _dumpFnTy(F);
-    dumpGVInfo(F);
+  /// MST numbers the unnamed values and Layouts caches the type sizes, both
+  /// are reused across the functions dumped by one thread
+  bool runOnFunc(Function &F, TypeLayoutCache &Layouts, ModuleSlotTracker &MST, raw_ostream &OS) {
+    WITH_COLOR_OS(OS, raw_ostream::RED,
+               OS << "\n===> FUNC: " << F.getName() << "\n";);
+    _dumpFnTy(F, OS);
+    dumpGVInfo(F, OS);
+    if (GlobalsOnly) return false;
+    MST.incorporateFunction(F);
     for (auto &B : F) {
-      runOnBasicBlock(B, layout);
+      runOnBasicBlock(B, Layouts, MST, OS);
     }
     return false;
   }
 
   bool runOnModule(Module &M) override {
     auto &layout = M.getDataLayout();
+    std::vector<Function *> fns;
     for (auto &F : M) {
-      runOnFunc(F, layout);
+      if (!Filter || Filter->match(F.getName())) fns.push_back(&F);
+    }
+    // the -j threads share the DataLayout, whose struct layouts are built
+    // lazily and without a lock
+    if (NumThreads != 1) layoutStructTypes(M);
+    if (Loops || Hot) {
+      runLoops(M, fns);
+      return false;
+    }
+    if (Format == DumpFormat::Jsonl) {
+      runJsonl(M, fns);
+      return false;
+    }
+
+    raw_ostream &OS = Out;
+    if (NumThreads == 1) {
+      ModuleSlotTracker MST(&M);
+      TypeLayoutCache Layouts(layout);
+      for (auto *F : fns) {
+        runOnFunc(*F, Layouts, MST, OS);
+      }
+    } else {
+      runOnFuncsParallel(fns, OS, [&](ArrayRef<Function *> Chunk, MutableArrayRef<std::string> Buffers) {
+        ModuleSlotTracker MST(&M);
+        TypeLayoutCache Layouts(layout);
+        for (size_t i = 0; i < Chunk.size(); ++i) {
+          raw_string_ostream OS(Buffers[i]);
+          // same escape codes as Out would write
+          OS.enable_colors(diag::hasColors(Out));
+          runOnFunc(*Chunk[i], Layouts, MST, OS);
+        }
+      });
     }
-    printGlobalValues(M);
-    printNMetadata(M);
+    printGlobalValues(M, OS);
+    printNMetadata(M, OS);
     return false;
   }
+
+  void runJsonl(Module &M, ArrayRef<Function *> fns) {
+    raw_ostream &OS = Out;
+    JsonlWriter writer(M.getDataLayout());
+    writer.writeModule(M, OS);
+    writer.writeGlobals(M, OS);
+    if (NumThreads == 1) {
+      for (auto *F : fns) writer.writeFunction(*F, OS);
+      return;
+    }
+    runOnFuncsParallel(fns, OS, [&](ArrayRef<Function *> Chunk, MutableArrayRef<std::string> Buffers) {
+      JsonlWriter writer(M.getDataLayout());
+      for (size_t i = 0; i < Chunk.size(); ++i) {
+        raw_string_ostream OS(Buffers[i]);
+        writer.writeFunction(*Chunk[i], OS);
+      }
+    });
+  }
+
+  /// --loops: the loop nests are built on the -j threads, the trip counts
+  /// one function at a time, as ScalarEvolution and AssumptionCache create
+  /// constants and value handles in the module's LLVMContext. For
+  /// --hot-loops the costs are collected under the same lock and nothing is
+  /// printed
+  void runLoops(Module &M, ArrayRef<Function *> fns) {
+    raw_ostream &OS = Out;
+    TargetLibraryInfoImpl TLII(Triple(M.getTargetTriple()));
+    std::mutex scevLock;
+    std::vector<HotLoop> hot;
+    auto report = [&](Function &F, raw_ostream &OS) {
+      if (F.isDeclaration()) return;
+      DominatorTree DT(F);
+      LoopInfo LI(DT);
+      LoopNestReport nest(F, LI);
+      if (!nest.empty()) {
+        std::lock_guard<std::mutex> lock(scevLock);
+        TargetLibraryInfo TLI(TLII, &F);
+        AssumptionCache AC(F);
+        ScalarEvolution SE(F, TLI, AC, DT, LI);
+        nest.addTripCounts(SE);
+        if (Hot) collectHotLoops(nest, computeLoopCosts(nest), M.getModuleIdentifier(), hot);
+      }
+      if (Hot) return;
+      if (Format == DumpFormat::Jsonl) {
+        nest.writeJsonl(OS);
+        return;
+      }
+      WITH_COLOR_OS(OS, raw_ostream::RED, OS << "\n===> FUNC: " << F.getName() << "\n";);
+      if (nest.empty()) {
+        OS << "no loop inside\n";
+      } else {
+        nest.print(OS);
+      }
+    };
+
+    if (Format == DumpFormat::Jsonl && !Hot) JsonlWriter(M.getDataLayout()).writeModule(M, OS);
+    if (NumThreads == 1) {
+      for (auto *F : fns) report(*F, OS);
+    } else {
+      runOnFuncsParallel(fns, OS, [&](ArrayRef<Function *> Chunk, MutableArrayRef<std::string> Buffers) {
+        for (size_t i = 0; i < Chunk.size(); ++i) {
+          raw_string_ostream OS(Buffers[i]);
+          OS.enable_colors(diag::hasColors(Out));
+          report(*Chunk[i], OS);
+        }
+      });
+    }
+    if (Hot) Hot->add(std::move(hot));
+  }
+
+  /// dumps the functions on a thread pool, DumpChunk writes each function of
+  /// a task into its buffer, and the buffers go to Out in module order; a
+  /// window of functions at a time, so the memory held does not grow with
+  /// the module
+  void runOnFuncsParallel(ArrayRef<Function *> fns, raw_ostream &Out,
+                          function_ref<void(ArrayRef<Function *>, MutableArrayRef<std::string>)> DumpChunk) {
+    ThreadPool pool(hardware_concurrency(NumThreads));
+    unsigned numThreads = pool.getThreadCount();
+    size_t window = size_t(numThreads) * k_fnsPerTask * 4;
+    std::vector<std::string> buffers(window);
+    for (size_t beg = 0; beg < fns.size(); beg += window) {
+      size_t end = std::min(fns.size(), beg + window);
+      for (size_t task = beg; task < end; task += k_fnsPerTask) {
+        pool.async([&, task] {
+          size_t n = std::min(end - task, k_fnsPerTask);
+          DumpChunk(fns.slice(task, n), MutableArrayRef<std::string>(buffers).slice(task - beg, n));
+        });
+      }
+      pool.wait();
+      for (size_t i = beg; i < end; ++i) {
+        Out << buffers[i - beg];
+        buffers[i - beg].clear();
+      }
+    }
+  }
 };
 
 char DumpModulePass::ID = 0;
 
-int main(int argc, char **argv) {
-  if (argc < 2) {
-    errs() << "Usage: " << argv[0] << " <IR file>\n";
-    std::exit(1);
+/// --cache-dir: the rendered dump of a file, stored under the MD5 of the IR
+/// buffer, the options the dump depends on and the ir_dump.out binary.
+/// An entry is a header (magic, dump size) and the zlib-compressed dump;
+/// it is written to a temporary file and renamed, so concurrent runs never
+/// see half an entry, and mapped back on lookup
+class DumpCache {
+ public:
+  static constexpr StringLiteral k_magic = "IRDUMPC1";
+  static size_t const k_headerSize = 16;
+
+  /// Dir is created if missing, Tool is the path of this binary
+  static Expected<DumpCache> open(StringRef Dir, StringRef Tool) {
+    if (!zlib::isAvailable()) return createStringError(inconvertibleErrorCode(), "LLVM was built without zlib");
+    if (auto EC = sys::fs::create_directories(Dir)) return createStringError(EC, Dir + ": " + EC.message());
+    DumpCache cache;
+    cache.Dir = Dir.str();
+    // a rebuilt tool may dump differently, its stamp invalidates the entries
+    sys::fs::file_status status;
+    if (!sys::fs::status(Tool, status)) {
+      raw_string_ostream OS(cache.ToolStamp);
+      OS << status.getSize() << ":" << status.getLastModificationTime().time_since_epoch().count();
+    }
+    return cache;
+  }
+
+  std::string key(MemoryBuffer const &Buf, bool Colors) const {
+    MD5 md5;
+    md5.update(Buf.getBuffer());
+    for (StringRef field : {StringRef(k_magic), StringRef(ToolStamp), StringRef(FunctionFilter)}) {
+      md5.update(field);
+      md5.update(StringRef("\0", 1));
+    }
+    md5.update({uint8_t(Format.getValue()), uint8_t(GlobalsOnly), uint8_t(Colors), uint8_t(Loops)});
+    // the jsonl module record names the file
+    if (Format == DumpFormat::Jsonl) md5.update(Buf.getBufferIdentifier());
+    MD5::MD5Result result;
+    md5.final(result);
+    return result.digest().str().str();
   }
 
+  /// writes the dump stored under Key to OS, false on a miss
+  bool lookup(StringRef Key, raw_ostream &OS) const {
+    auto buf = MemoryBuffer::getFile(pathOf(Key), false, false);
+    if (!buf) return false;
+    StringRef data = (*buf)->getBuffer();
+    if (data.size() < k_headerSize || !data.startswith(k_magic)) return false;
+    uint64_t size = support::endian::read64le(data.data() + k_magic.size());
+    SmallVector<char, 0> dump;
+    if (Error E = zlib::uncompress(data.drop_front(k_headerSize), dump, size)) {
+      consumeError(std::move(E));
+      return false;
+    }
+    OS << StringRef(dump.data(), dump.size());
+    return true;
+  }
+
+  /// an entry that cannot be written is left out, the dump is still correct
+  void store(StringRef Key, StringRef Dump) const {
+    SmallVector<char, 0> packed;
+    if (Error E = zlib::compress(Dump, packed, zlib::BestSpeedCompression)) {
+      consumeError(std::move(E));
+      return;
+    }
+    std::string path = pathOf(Key);
+    SmallString<128> tmp;
+    int fd;
+    if (sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, tmp)) return;
+    bool written;
+    {
+      raw_fd_ostream OS(fd, true);
+      char size[8];
+      support::endian::write64le(size, Dump.size());
+      OS << k_magic;
+      OS.write(size, sizeof(size));
+      OS.write(packed.data(), packed.size());
+      OS.close();
+      written = !OS.has_error();
+      OS.clear_error();
+    }
+    if (!written || sys::fs::rename(tmp, path)) sys::fs::remove(tmp);
+  }
+
+ private:
+  std::string Dir;
+  std::string ToolStamp;
+
+  std::string pathOf(StringRef Key) const {
+    SmallString<128> path(Dir);
+    sys::path::append(path, Key + ".dump");
+    return path.str().str();
+  }
+};
+
+/// bitcode function bodies stay on disk until materialized, only the
+/// functions Filter selects are; textual IR is parsed in full either way
+static Expected<std::unique_ptr<Module>> loadModule(std::unique_ptr<MemoryBuffer> Buf, LLVMContext &Ctx,
+                                                    Regex const *Filter) {
   SMDiagnostic Err;
+  std::unique_ptr<Module> Mod(getLazyIRModule(std::move(Buf), Err, Ctx));
+  if (!Mod) {
+    std::string msg;
+    raw_string_ostream OS(msg);
+    Err.print("ir_dump.out", OS, false);
+    return createStringError(inconvertibleErrorCode(), StringRef(OS.str()).rtrim());
+  }
+  if (GlobalsOnly) return Mod;
+  for (auto &F : *Mod) {
+    if (Filter && !Filter->match(F.getName())) continue;
+    if (Error E = F.materialize()) {
+      return createStringError(inconvertibleErrorCode(), F.getName() + ": " + toString(std::move(E)));
+    }
+  }
+  return Mod;
+}
+
+/// the files named on the command line and by --files-from, directories are
+/// walked for .ll and .bc files in sorted order
+static std::vector<std::string> collectInputs() {
+  std::vector<std::string> names(InputFilenames.begin(), InputFilenames.end());
+  if (!FilesFrom.empty()) {
+    auto buf = MemoryBuffer::getFileOrSTDIN(FilesFrom);
+    if (!buf) {
+      errs() << FilesFrom << ": " << buf.getError().message() << "\n";
+      std::exit(1);
+    }
+    SmallVector<StringRef, 0> lines;
+    (*buf)->getBuffer().split(lines, '\n', -1, false);
+    for (auto line : lines) {
+      line = line.trim();
+      if (!line.empty()) names.push_back(line.str());
+    }
+  }
+
+  std::vector<std::string> files;
+  for (auto &name : names) {
+    if (!sys::fs::is_directory(name)) {
+      files.push_back(name);
+      continue;
+    }
+    std::vector<std::string> found;
+    std::error_code EC;
+    for (sys::fs::recursive_directory_iterator it(name, EC), end; it != end && !EC; it.increment(EC)) {
+      StringRef path = it->path();
+      if ((path.endswith(".ll") || path.endswith(".bc")) && it->type() != sys::fs::file_type::directory_file) {
+        found.push_back(path.str());
+      }
+    }
+    if (EC) {
+      errs() << name << ": " << EC.message() << "\n";
+      std::exit(1);
+    }
+    llvm::sort(found);
+    files.insert(files.end(), found.begin(), found.end());
+  }
+  return files;
+}
+
+/// dumps one file into OS, from Cache if it has it, or adds its loops to
+/// Hot. In batch mode the file gets a section and a load error is reported
+/// in the output, otherwise on stderr
+static bool dumpFile(StringRef Path, Regex const *Filter, DumpCache const *Cache, HotLoopRanking *Hot,
+                     raw_ostream &OS, unsigned NumThreads, bool Batch) {
+  if (Batch && Format == DumpFormat::Text && !Hot) {
+    WITH_COLOR_OS(OS, raw_ostream::GREEN, OS << "\n===> FILE: " << Path << "\n";);
+  }
+  auto reportError = [&](StringRef Msg) {
+    if (!Batch) {
+      errs() << Msg << "\n";
+    } else if (Format == DumpFormat::Jsonl) {
+      json::OStream J(OS);
+      J.object([&] {
+        J.attribute("rec", "error");
+        J.attribute("file", Path);
+        J.attribute("message", Msg);
+      });
+      OS << "\n";
+    } else {
+      OS << Msg << "\n";
+    }
+    return false;
+  };
+
+  auto Buf = MemoryBuffer::getFileOrSTDIN(Path);
+  if (!Buf) return reportError(("ir_dump.out: " + Path + ": error: Could not open input file: " + Buf.getError().message()).str());
+  std::string key;
+  if (Cache) {
+    key = Cache->key(**Buf, diag::hasColors(OS));
+    if (Cache->lookup(key, OS)) return true;
+  }
+
   LLVMContext ctx;
-  std::unique_ptr<Module> Mod(parseIRFile(argv[1], Err, ctx));
+  auto Mod = loadModule(std::move(*Buf), ctx, Filter);
+  if (!Mod) return reportError(toString(Mod.takeError()));
+  legacy::PassManager PM;
+  if (!Cache) {
+    PM.add(new DumpModulePass(Filter, OS, NumThreads, Hot));
+    PM.run(**Mod);
+    return true;
+  }
+  std::string dump;
+  raw_string_ostream DS(dump);
+  DS.enable_colors(diag::hasColors(OS));
+  PM.add(new DumpModulePass(Filter, DS, NumThreads));
+  PM.run(**Mod);
+  Cache->store(key, DS.str());
+  OS << dump;
+  return true;
+}
 
-  if (!Mod) {
-    Err.print(argv[0], errs());
+/// batch mode: each file is loaded into its own LLVMContext and dumped into
+/// a buffer on a thread pool, the buffers go to Out in input order; a window
+/// of files at a time, so the memory held does not grow with the batch
+static bool dumpFiles(ArrayRef<std::string> Files, Regex const *Filter, DumpCache const *Cache, HotLoopRanking *Hot,
+                      raw_ostream &Out) {
+  ThreadPool pool(hardware_concurrency(Jobs));
+  size_t window = size_t(pool.getThreadCount()) * k_filesPerThread;
+  std::vector<std::string> buffers(window);
+  std::atomic<bool> ok(true);
+  for (size_t beg = 0; beg < Files.size(); beg += window) {
+    size_t end = std::min(Files.size(), beg + window);
+    for (size_t i = beg; i < end; ++i) {
+      pool.async([&, i] {
+        raw_string_ostream OS(buffers[i - beg]);
+        OS.enable_colors(diag::hasColors(Out));
+        if (!dumpFile(Files[i], Filter, Cache, Hot, OS, 1, true)) ok = false;
+      });
+    }
+    pool.wait();
+    for (size_t i = beg; i < end; ++i) {
+      Out << buffers[i - beg];
+      std::string().swap(buffers[i - beg]);
+    }
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  cl::ParseCommandLineOptions(argc, argv,
+                              "dumps the functions, blocks and instructions of IR files\n\n"
+                              "With several files, a directory or --files-from, the files are dumped in\n"
+                              "batch mode: -j files at a time, one section per file, in input order.\n"
+                              "--loops reports the loop nests instead, e.g. to survey a codebase for\n"
+                              "vectorization candidates, and --hot-loops=N ranks the loops of all the\n"
+                              "inputs by a static cost model to pick the ones worth a closer look.\n");
+
+  Optional<Regex> filter;
+  if (!FunctionFilter.empty()) {
+    std::string error;
+    filter.emplace(FunctionFilter);
+    if (!filter->isValid(error)) {
+      errs() << "--function: " << error << "\n";
+      std::exit(1);
+    }
+  }
+  if (filter && GlobalsOnly) {
+    errs() << "--function and --globals-only cannot be combined\n";
     std::exit(1);
   }
+  if ((Loops || HotLoops) && GlobalsOnly) {
+    errs() << "--loops and --hot-loops cannot be combined with --globals-only\n";
+    std::exit(1);
+  }
+  if (Loops && HotLoops) {
+    errs() << "--loops and --hot-loops cannot be combined\n";
+    std::exit(1);
+  }
+  // the cache holds rendered dumps, a ranking spans all the inputs
+  if (HotLoops && !CacheDir.empty()) {
+    errs() << "--hot-loops and --cache-dir cannot be combined\n";
+    std::exit(1);
+  }
+  Regex const *Filter = filter ? filter.getPointer() : nullptr;
 
-  legacy::PassManager PM;
-  PM.add(new DumpModulePass());
-  PM.run(*Mod);
+  std::vector<std::string> files = collectInputs();
+  if (files.empty()) {
+    errs() << "no IR file given\n";
+    std::exit(1);
+  }
+  bool batch = files.size() > 1 || !FilesFrom.empty() || any_of(InputFilenames, [](std::string const &name) {
+                 return sys::fs::is_directory(name);
+               });
+
+  std::unique_ptr<raw_fd_ostream> jsonlOut;
+  if (Format == DumpFormat::Jsonl) {
+    std::error_code EC;
+    jsonlOut = std::make_unique<raw_fd_ostream>(OutputFilename, EC, sys::fs::OF_None);
+    if (EC) {
+      errs() << OutputFilename << ": " << EC.message() << "\n";
+      std::exit(1);
+    }
+  }
+  raw_ostream &Out = jsonlOut ? *jsonlOut : errs();
+
+  Optional<DumpCache> cache;
+  if (!CacheDir.empty()) {
+    auto opened = DumpCache::open(CacheDir, sys::fs::getMainExecutable(argv[0], (void *)&main));
+    if (!opened) {
+      logAllUnhandledErrors(opened.takeError(), errs(), "--cache-dir: ");
+      std::exit(1);
+    }
+    cache.emplace(std::move(*opened));
+  }
+  DumpCache const *Cache = cache ? cache.getPointer() : nullptr;
+
+  Optional<HotLoopRanking> hot;
+  if (HotLoops) hot.emplace(HotLoops);
+  HotLoopRanking *Hot = hot ? hot.getPointer() : nullptr;
 
-  return 0;
+  // materializing is not thread-safe, loadModule does it before -j takes over
+  bool ok = batch ? dumpFiles(files, Filter, Cache, Hot, Out)
+                  : dumpFile(files.front(), Filter, Cache, Hot, Out, Jobs, false);
+  if (Hot) Hot->print(Out);
+  return ok ? 0 : 1;
 }